@@ -40,6 +40,100 @@ void block_sync::consensus(const uint64_t height, const name& synchronizer, cons
     if (block_miner_itr != block_miner_end) {
         block_miner_idx.erase(block_miner_itr);
     }
+
+    // erase merkle cache, buckets of competing blocks at this height keep their entries until it is irreversible
+    merkle_cache_table _merkle_cache(get_self(), height);
+    auto merkle_cache_itr = _merkle_cache.begin();
+    while (merkle_cache_itr != _merkle_cache.end()) {
+        if (merkle_cache_itr->hash == hash) {
+            merkle_cache_itr = _merkle_cache.erase(merkle_cache_itr);
+        } else {
+            merkle_cache_itr++;
+        }
+    }
+
+    // erase block header, the consensus block is served by utxomng.xsat and the competing headers are erased once
+    // the height is irreversible
+    block_header_table _block_header(get_self(), height);
+    auto block_header_idx = _block_header.get_index<"byhash"_n>();
+    auto block_header_itr = block_header_idx.find(hash);
+    if (block_header_itr != block_header_idx.end()) {
+        block_header_idx.erase(block_header_itr);
+    }
+}
+
+//@auth get_self()
+[[eosio::action]]
+void block_sync::config(const bool require_headers) {
+    require_auth(get_self());
+
+    config_table _config(get_self(), get_self().value);
+    auto config = _config.get_or_default();
+    config.require_headers = require_headers;
+    _config.set(config, get_self());
+}
+
+//@auth synchronizer
+[[eosio::action]]
+void block_sync::pushheaders(const name& synchronizer, const uint64_t height, const std::vector<char>& headers) {
+    require_auth(synchronizer);
+
+    check(height > START_HEIGHT, "2030:blksync.xsat::pushheaders: height must be greater than 840000");
+    check(!headers.empty() && headers.size() % BLOCK_HEADER_SIZE == 0,
+          "2031:blksync.xsat::pushheaders: headers must be a non-empty sequence of 80-byte block headers");
+
+    // check whether it is a synchronizer
+    pool::synchronizer_table _synchronizer(POOL_REGISTER_CONTRACT, POOL_REGISTER_CONTRACT.value);
+    _synchronizer.require_find(synchronizer.value, "2032:blksync.xsat::pushheaders: not an synchronizer account");
+
+    eosio::datastream<const char*> header_stream(headers.data(), headers.size());
+    const uint64_t num_headers = headers.size() / BLOCK_HEADER_SIZE;
+    checksum256 first_hash;
+    uint64_t num_saved = 0;
+    for (uint64_t i = 0; i < num_headers; i++) {
+        const uint64_t header_height = height + i;
+        bitcoin::core::block_header block_header;
+        header_stream >> block_header;
+        auto hash = bitcoin::be_checksum256_from_uint(block_header.hash());
+        if (i == 0) {
+            first_hash = hash;
+        }
+
+        // already pushed or reached consensus
+        block_header_table _block_header(get_self(), header_height);
+        auto block_header_idx = _block_header.get_index<"byhash"_n>();
+        if (block_header_idx.find(hash) != block_header_idx.end()
+            || utxo_manage::check_consensus(header_height, hash)) {
+            continue;
+        }
+
+        check(!block_header.version_are_invalid(header_height, CHAIN_PARAMS),
+              "2033:blksync.xsat::pushheaders: bad-version");
+        check(block_header.target_is_valid(), "2034:blksync.xsat::pushheaders: invalid_target");
+
+        auto previous_block_hash = bitcoin::be_checksum256_from_uint(block_header.previous_block_hash);
+        auto parent_block = get_header_ancestor(header_height - 1, previous_block_hash);
+        check(parent_block.has_value(), "2035:blksync.xsat::pushheaders: parent block does not exist");
+
+        auto expected_bits = bitcoin::core::get_next_work_required(*parent_block, block_header.timestamp,
+                                                                   get_header_ancestor, CHAIN_PARAMS);
+        check(block_header.bits == expected_bits, "2036:blksync.xsat::pushheaders: bad-diffbits");
+
+        _block_header.emplace(get_self(), [&](auto& row) {
+            row.id = _block_header.available_primary_key();
+            row.hash = hash;
+            row.previous_block_hash = previous_block_hash;
+            row.cumulative_work = bitcoin::be_checksum256_from_uint(
+                block_header.work() + bitcoin::be_uint_from_checksum256(parent_block->cumulative_work));
+            row.timestamp = block_header.timestamp;
+            row.bits = block_header.bits;
+        });
+        num_saved++;
+    }
+
+    // fee deduction, every saved header is charged
+    resource_management::pay_action pay(RESOURCE_MANAGE_CONTRACT, {get_self(), "active"_n});
+    pay.send(height, first_hash, synchronizer, PUSH_CHUNK, std::max<uint64_t>(num_saved, 1));
 }
 
 //@auth utxomng.xsat
@@ -47,13 +141,27 @@ void block_sync::consensus(const uint64_t height, const name& synchronizer, cons
 void block_sync::delchunks(const uint64_t bucket_id) {
     require_auth(UTXO_MANAGE_CONTRACT);
 
-    // erase block.chunk
-    auto iter = eosio::internal_use_do_not_use::db_lowerbound_i64(get_self().value, bucket_id, BLOCK_CHUNK.value, 0);
-    while (iter >= 0) {
-        uint64_t ignored;
-        auto next_iter = eosio::internal_use_do_not_use::db_next_i64(iter, &ignored);
-        eosio::internal_use_do_not_use::db_remove_i64(iter);
-        iter = next_iter;
+    // erase chunks
+    erase_bucket_chunks(bucket_id);
+}
+
+//@auth utxomng.xsat
+[[eosio::action]]
+void block_sync::erase(const uint64_t height) {
+    require_auth(UTXO_MANAGE_CONTRACT);
+
+    // erase merkle cache of all blocks at this height
+    merkle_cache_table _merkle_cache(get_self(), height);
+    auto merkle_cache_itr = _merkle_cache.begin();
+    while (merkle_cache_itr != _merkle_cache.end()) {
+        merkle_cache_itr = _merkle_cache.erase(merkle_cache_itr);
+    }
+
+    // erase block headers of all blocks at this height, ancestors are served by utxomng.xsat from now on
+    block_header_table _block_header(get_self(), height);
+    auto block_header_itr = _block_header.begin();
+    while (block_header_itr != _block_header.end()) {
+        block_header_itr = _block_header.erase(block_header_itr);
     }
 }
 
@@ -77,6 +185,14 @@ void block_sync::initbucket(const name& synchronizer, const uint64_t height, con
     check(!utxo_manage::check_consensus(height, hash),
           "2005:blksync.xsat::initbucket: the block has reached consensus");
 
+    config_table _config(get_self(), get_self().value);
+    if (_config.get_or_default().require_headers) {
+        block_header_table _block_header(get_self(), height);
+        auto block_header_idx = _block_header.get_index<"byhash"_n>();
+        check(block_header_idx.find(hash) != block_header_idx.end(),
+              "2037:blksync.xsat::initbucket: the block header has not been pushed");
+    }
+
     // fee deduction
     resource_management::pay_action pay(RESOURCE_MANAGE_CONTRACT, {get_self(), "active"_n});
     pay.send(height, hash, synchronizer, PUSH_CHUNK, 1);
@@ -118,6 +234,7 @@ void block_sync::initbucket(const name& synchronizer, const uint64_t height, con
             row.chunk_size = chunk_size;
             row.status = uploading;
             row.updated_at = current_time_point();
+            row.verify_info = std::nullopt;
         });
     }
 
@@ -141,55 +258,82 @@ void block_sync::pushchunk(const name& synchronizer, const uint64_t height, cons
     check(data_size == (size_t)size, "2010:blksync.xsat::pushchunk: data size does not match");
     check(data_size > 0, "2011:blksync.xsat::pushchunk: data size must be greater than 0");
 
-    block_bucket_table _block_bucket = block_bucket_table(get_self(), synchronizer.value);
-    auto block_bucket_idx = _block_bucket.get_index<"byblockid"_n>();
-    auto block_bucket_itr = block_bucket_idx.require_find(
-        xsat::utils::compute_block_id(height, hash), "2012:blksync.xsat::pushchunk: [blockbuckets] does not exists");
+    uint64_t bucket_id;
+    uint8_t uploaded_num_chunks;
+    store_chunks(synchronizer, height, hash, {{chunk_id, _ds.pos(), static_cast<uint32_t>(data_size)}}, bucket_id,
+                 uploaded_num_chunks);
 
-    auto status = block_bucket_itr->status;
-    check(
-        status == uploading || status == upload_complete || status == verify_fail,
-        "2013:blksync.xsat::pushchunk: cannot push chunk in the current state [" + get_block_status_name(status) + "]");
+    // log
+    block_sync::chunklog_action _chunklog(get_self(), {get_self(), "active"_n});
+    _chunklog.send(bucket_id, chunk_id, uploaded_num_chunks);
+}
 
-    // fee deduction
-    resource_management::pay_action pay(RESOURCE_MANAGE_CONTRACT, {get_self(), "active"_n});
-    pay.send(height, hash, synchronizer, PUSH_CHUNK, 1);
+//@auth synchronizer
+[[eosio::action]]
+void block_sync::pushchunks(const name& synchronizer, const uint64_t height, const checksum256& hash,
+                            const eosio::ignore<std::vector<chunk_data>>& chunks) {
+    require_auth(synchronizer);
 
-    uint32_t pre_size = 0;
-    // emplace/modify chunk
-    auto bucket_id = block_bucket_itr->bucket_id;
-    auto chunk_itr
-        = eosio::internal_use_do_not_use::db_find_i64(get_self().value, bucket_id, BLOCK_CHUNK.value, chunk_id);
-    if (chunk_itr >= 0) {
-        pre_size = eosio::internal_use_do_not_use::db_get_i64(chunk_itr, nullptr, 0);
-        eosio::internal_use_do_not_use::db_update_i64(chunk_itr, get_self().value, _ds.pos(), data_size);
-    } else {
-        eosio::internal_use_do_not_use::db_store_i64(bucket_id, BLOCK_CHUNK.value, get_self().value, chunk_id,
-                                                     _ds.pos(), data_size);
+    check(!utxo_manage::check_consensus(height, hash),
+          "2009:blksync.xsat::pushchunks: the block has reached consensus");
+
+    // read the chunk list in place without copying the data
+    eosio::unsigned_int num_chunks;
+    _ds >> num_chunks;
+    check(num_chunks.value > 0, "2025:blksync.xsat::pushchunks: chunks cannot be empty");
+
+    std::vector<chunk_input> chunk_inputs;
+    chunk_inputs.reserve(num_chunks.value);
+    std::vector<uint8_t> chunk_ids;
+    chunk_ids.reserve(num_chunks.value);
+    for (auto i = 0; i < num_chunks.value; i++) {
+        uint8_t chunk_id;
+        eosio::unsigned_int size;
+        _ds >> chunk_id;
+        _ds >> size;
+        check(size.value > 0, "2011:blksync.xsat::pushchunks: data size must be greater than 0");
+        check(_ds.remaining() >= size.value, "2010:blksync.xsat::pushchunks: data size does not match");
+        check(std::find(chunk_ids.begin(), chunk_ids.end(), chunk_id) == chunk_ids.end(),
+              "2026:blksync.xsat::pushchunks: duplicate chunk_id");
+
+        chunk_inputs.push_back({chunk_id, _ds.pos(), size.value});
+        chunk_ids.push_back(chunk_id);
+        _ds.skip(size.value);
     }
-    block_bucket_idx.modify(block_bucket_itr, same_payer, [&](auto& row) {
-        if (chunk_itr < 0) {
-            row.uploaded_num_chunks += 1;
-            row.chunk_ids.insert(chunk_id);
-        }
-        row.uploaded_size = row.uploaded_size + data_size - pre_size;
+    check(_ds.remaining() == 0, "2010:blksync.xsat::pushchunks: data size does not match");
 
-        check(row.uploaded_num_chunks <= row.num_chunks,
-              "2023:blksync.xsat::pushchunk: the number of uploaded chunks has exceeded [num_chunks]");
-        check(row.uploaded_size <= row.size,
-              "2024:blksync.xsat::pushchunk: the upload chunk data size has exceeded [size]");
-
-        if (row.uploaded_size == row.size && row.uploaded_num_chunks == row.num_chunks) {
-            row.status = upload_complete;
-        } else {
-            row.status = uploading;
-        }
-        row.updated_at = current_time_point();
-    });
+    uint64_t bucket_id;
+    uint8_t uploaded_num_chunks;
+    store_chunks(synchronizer, height, hash, chunk_inputs, bucket_id, uploaded_num_chunks);
 
     // log
-    block_sync::chunklog_action _chunklog(get_self(), {get_self(), "active"_n});
-    _chunklog.send(block_bucket_itr->bucket_id, chunk_id, block_bucket_itr->uploaded_num_chunks);
+    block_sync::chunkslog_action _chunkslog(get_self(), {get_self(), "active"_n});
+    _chunkslog.send(bucket_id, chunk_ids, uploaded_num_chunks);
+}
+
+//@auth synchronizer
+[[eosio::action]]
+void block_sync::verifymode(const name& synchronizer, const bool verify_on_upload) {
+    require_auth(synchronizer);
+
+    // check whether it is a synchronizer
+    pool::synchronizer_table _synchronizer(POOL_REGISTER_CONTRACT, POOL_REGISTER_CONTRACT.value);
+    _synchronizer.require_find(synchronizer.value, "2027:blksync.xsat::verifymode: not an synchronizer account");
+
+    verify_mode_table _verify_mode(get_self(), get_self().value);
+    auto verify_mode_itr = _verify_mode.find(synchronizer.value);
+    if (!verify_on_upload) {
+        if (verify_mode_itr != _verify_mode.end()) {
+            _verify_mode.erase(verify_mode_itr);
+        }
+        return;
+    }
+    if (verify_mode_itr == _verify_mode.end()) {
+        _verify_mode.emplace(get_self(), [&](auto& row) {
+            row.synchronizer = synchronizer;
+            row.verify_on_upload = verify_on_upload;
+        });
+    }
 }
 
 //@auth synchronizer
@@ -215,12 +359,19 @@ void block_sync::delchunk(const name& synchronizer, const uint64_t height, const
 
     auto bucket_id = block_bucket_itr->bucket_id;
 
-    auto chunk_itr
-        = eosio::internal_use_do_not_use::db_find_i64(get_self().value, bucket_id, BLOCK_CHUNK.value, chunk_id);
-    check(chunk_itr >= 0, "2016:blksync.xsat::delchunk: chunk_id does not exist");
+    auto chunk_offsets = get_chunk_offsets(bucket_id, block_bucket_itr->chunk_ids);
+    auto chunk = chunk_offsets.find_chunk(chunk_id);
+    check(chunk != nullptr, "2016:blksync.xsat::delchunk: chunk_id does not exist");
+    auto verify_info = block_bucket_itr->verify_info.value_or(verify_info_data{});
+    check(chunk->offset >= verify_info.processed_position,
+          "2029:blksync.xsat::delchunk: cannot delete a chunk that has been verified");
+    auto chunk_size = chunk->size;
+    release_chunk_data(bucket_id, *chunk);
 
-    auto chunk_size = eosio::internal_use_do_not_use::db_get_i64(chunk_itr, nullptr, 0);
-    eosio::internal_use_do_not_use::db_remove_i64(chunk_itr);
+    // update chunk offsets
+    chunk_offset_table _chunk_offset(get_self(), bucket_id);
+    chunk_offsets.erase_chunk(chunk_id);
+    _chunk_offset.set(chunk_offsets, get_self());
 
     block_bucket_idx.modify(block_bucket_itr, same_payer, [&](auto& row) {
         row.uploaded_num_chunks -= 1;
@@ -257,14 +408,8 @@ void block_sync::delbucket(const name& synchronizer, const uint64_t height, cons
 
     auto bucket_id = block_bucket_itr->bucket_id;
 
-    // erase block.chunk
-    auto iter = eosio::internal_use_do_not_use::db_lowerbound_i64(get_self().value, bucket_id, BLOCK_CHUNK.value, 0);
-    while (iter >= 0) {
-        uint64_t ignored;
-        auto next_iter = eosio::internal_use_do_not_use::db_next_i64(iter, &ignored);
-        eosio::internal_use_do_not_use::db_remove_i64(iter);
-        iter = next_iter;
-    }
+    // erase chunks
+    erase_bucket_chunks(bucket_id);
 
     // erase block bucket
     block_bucket_idx.erase(block_bucket_itr);
@@ -307,18 +452,50 @@ block_sync::verify_block_result block_sync::verify(const name& synchronizer, con
 
     auto verify_info = block_bucket_itr->verify_info.value_or(verify_info_data{});
     if (status == upload_complete || status == verify_merkle) {
-        // check merkle
-        auto error_msg = check_merkle(block_bucket_itr, verify_info);
-        if (error_msg.has_value()) {
-            return check_fail(block_bucket_idx, block_bucket_itr, *error_msg, hash);
+        merkle_cache_table _merkle_cache(get_self(), height);
+        auto merkle_cache_idx = _merkle_cache.get_index<"bydigest"_n>();
+        auto digest = compute_bucket_digest(block_bucket_itr->bucket_id);
+
+        // reuse the merkle verification of a bucket with the same content
+        auto merkle_cache_itr = merkle_cache_idx.end();
+        if (digest.has_value()) {
+            merkle_cache_itr = merkle_cache_idx.find(compute_merkle_cache_key(hash, *digest));
         }
-
-        // next action
-        if (verify_info.num_transactions == verify_info.processed_transactions
-            && verify_info.processed_position == block_bucket_itr->size) {
+        if (status == upload_complete && merkle_cache_itr != merkle_cache_idx.end()) {
+            verify_info = merkle_cache_itr->verify_info;
             status = verify_parent_hash;
+
+            // the bucket is parsed in the same ranges as the cached one
+            if (merkle_cache_itr->tx_offsets.has_value() && !merkle_cache_itr->tx_offsets->empty()) {
+                tx_offset_table _tx_offset(get_self(), block_bucket_itr->bucket_id);
+                _tx_offset.set({.offsets = *merkle_cache_itr->tx_offsets}, get_self());
+            }
         } else {
-            status = verify_merkle;
+            // check merkle
+            auto error_msg = check_merkle(block_bucket_itr, verify_info);
+            if (error_msg.has_value()) {
+                return check_fail(block_bucket_idx, block_bucket_itr, *error_msg, hash);
+            }
+
+            // next action
+            if (verify_info.num_transactions == verify_info.processed_transactions
+                && verify_info.processed_position == block_bucket_itr->size) {
+                status = verify_parent_hash;
+
+                // save the merkle verification for buckets with the same content
+                if (digest.has_value() && merkle_cache_itr == merkle_cache_idx.end()) {
+                    tx_offset_table _tx_offset(get_self(), block_bucket_itr->bucket_id);
+                    _merkle_cache.emplace(get_self(), [&](auto& row) {
+                        row.id = _merkle_cache.available_primary_key();
+                        row.hash = hash;
+                        row.digest = *digest;
+                        row.verify_info = verify_info;
+                        row.tx_offsets = _tx_offset.get_or_default().offsets;
+                    });
+                }
+            } else {
+                status = verify_merkle;
+            }
         }
 
         // update block status
@@ -340,7 +517,7 @@ block_sync::verify_block_result block_sync::verify(const name& synchronizer, con
                                                 + bitcoin::be_uint_from_checksum256(parent_block->cumulative_work));
 
         auto expected_bits = bitcoin::core::get_next_work_required(*parent_block, verify_info.timestamp,
-                                                                   utxo_manage::get_ancestor, CHAIN_PARAMS);
+                                                                   get_header_ancestor, CHAIN_PARAMS);
         if (verify_info.bits != expected_bits) {
             return check_fail(block_bucket_idx, block_bucket_itr, "bad-diffbits", hash);
         }
@@ -437,17 +614,20 @@ block_sync::verify_block_result block_sync::verify(const name& synchronizer, con
     return {.status = get_block_status_name(verify_pass), .block_hash = hash};
 }
 
-optional<string> block_sync::check_transaction(const bitcoin::core::transaction tx) {
-    if (tx.inputs.empty()) {
+optional<string> block_sync::check_transaction(const bitcoin::core::transaction_view& tx) {
+    if (tx.num_inputs == 0) {
         return "bad-txns-vin-empty";
     }
 
-    if (tx.outputs.empty()) {
+    if (tx.num_outputs == 0) {
         return "bad-txns-vout-empty";
     }
 
     uint64_t value_out = 0;
-    for (const auto& output : tx.outputs) {
+    bitcoin::core::output_view output;
+    auto offset = tx.outputs_offset;
+    for (uint64_t i = 0; i < tx.num_outputs; i++) {
+        offset = tx.read_output(offset, output);
         if (output.value > BTC_SUPPLY) {
             return "bad-txns-vout-toolarge";
         }
@@ -458,13 +638,16 @@ optional<string> block_sync::check_transaction(const bitcoin::core::transaction
     }
     auto is_coinbase = tx.is_coinbase();
     std::set<out_point> vin_out_points;
-    for (const auto& input : tx.inputs) {
+    bitcoin::core::input_view input;
+    offset = tx.inputs_offset;
+    for (uint64_t i = 0; i < tx.num_inputs; i++) {
+        offset = tx.read_input(offset, input);
         if (!vin_out_points.insert(out_point{.tx_id = input.previous_output_hash, .index = input.previous_output_index})
                  .second) {
             return "bad-txns-inputs-duplicate";
         }
         if (is_coinbase) {
-            auto script_size = tx.inputs[0].script_sig.data.size();
+            auto script_size = input.script_sig.size;
             if (script_size < 2 || script_size > 100) {
                 return "bad-cb-length";
             }
@@ -474,21 +657,115 @@ optional<string> block_sync::check_transaction(const bitcoin::core::transaction
             }
         }
     }
+    return std::nullopt;
+}
+
+//@private
+void block_sync::store_chunks(const name& synchronizer, const uint64_t height, const checksum256& hash,
+                              const std::vector<chunk_input>& chunks, uint64_t& bucket_id,
+                              uint8_t& uploaded_num_chunks) {
+    block_bucket_table _block_bucket = block_bucket_table(get_self(), synchronizer.value);
+    auto block_bucket_idx = _block_bucket.get_index<"byblockid"_n>();
+    auto block_bucket_itr = block_bucket_idx.require_find(
+        xsat::utils::compute_block_id(height, hash), "2012:blksync.xsat::pushchunk: [blockbuckets] does not exists");
+
+    auto status = block_bucket_itr->status;
+    check(
+        status == uploading || status == upload_complete || status == verify_fail,
+        "2013:blksync.xsat::pushchunk: cannot push chunk in the current state [" + get_block_status_name(status) + "]");
+
+    // fee deduction
+    resource_management::pay_action pay(RESOURCE_MANAGE_CONTRACT, {get_self(), "active"_n});
+    pay.send(height, hash, synchronizer, PUSH_CHUNK, chunks.size());
+
+    // emplace/modify chunk
+    bucket_id = block_bucket_itr->bucket_id;
+    auto chunk_offsets = get_chunk_offsets(bucket_id, block_bucket_itr->chunk_ids);
+    auto verify_info = block_bucket_itr->verify_info.value_or(verify_info_data{});
+    std::vector<uint8_t> new_chunk_ids;
+    int64_t size_delta = 0;
+    for (const auto& chunk : chunks) {
+        // acquire first so that re-uploading the same content does not free it
+        auto data_id = acquire_chunk_data(chunk.data, chunk.size);
+        auto pre_chunk = chunk_offsets.find_chunk(chunk.chunk_id);
+        if (pre_chunk != nullptr) {
+            check(pre_chunk->offset >= verify_info.processed_position,
+                  "2028:blksync.xsat::pushchunk: cannot replace a chunk that has been verified");
+            size_delta -= pre_chunk->size;
+            release_chunk_data(bucket_id, *pre_chunk);
+        } else {
+            new_chunk_ids.push_back(chunk.chunk_id);
+        }
+        size_delta += chunk.size;
+        chunk_offsets.set_chunk(chunk.chunk_id, chunk.size, data_id);
+    }
+
+    // update chunk offsets
+    chunk_offset_table _chunk_offset(get_self(), bucket_id);
+    _chunk_offset.set(chunk_offsets, get_self());
+
+    block_bucket_idx.modify(block_bucket_itr, same_payer, [&](auto& row) {
+        row.uploaded_num_chunks += new_chunk_ids.size();
+        row.chunk_ids.insert(new_chunk_ids.begin(), new_chunk_ids.end());
+        row.uploaded_size = row.uploaded_size + size_delta;
+
+        check(row.uploaded_num_chunks <= row.num_chunks,
+              "2023:blksync.xsat::pushchunk: the number of uploaded chunks has exceeded [num_chunks]");
+        check(row.uploaded_size <= row.size,
+              "2024:blksync.xsat::pushchunk: the upload chunk data size has exceeded [size]");
+
+        if (row.uploaded_size == row.size && row.uploaded_num_chunks == row.num_chunks) {
+            row.status = upload_complete;
+        } else {
+            row.status = uploading;
+        }
+        row.updated_at = current_time_point();
+    });
+    uploaded_num_chunks = block_bucket_itr->uploaded_num_chunks;
+
+    // verify the complete transactions of the contiguous uploaded chunks
+    verify_mode_table _verify_mode(get_self(), get_self().value);
+    auto verify_mode_itr = _verify_mode.find(synchronizer.value);
+    if (verify_mode_itr != _verify_mode.end() && verify_mode_itr->verify_on_upload) {
+        auto processed_position = verify_info.processed_position;
+        auto error_msg = check_merkle(block_bucket_itr, verify_info, true);
+        if (error_msg.has_value()) {
+            check_fail(block_bucket_idx, block_bucket_itr, *error_msg, hash);
+        } else if (verify_info.processed_position > processed_position) {
+            pay.send(height, hash, synchronizer, VERIFY, 1);
+            block_bucket_idx.modify(block_bucket_itr, same_payer, [&](auto& row) {
+                row.verify_info = verify_info;
+            });
+        }
+    }
 }
 
 //@private
 template <typename ITR>
-optional<string> block_sync::check_merkle(const ITR& block_bucket_itr, verify_info_data& verify_info) {
+optional<string> block_sync::check_merkle(const ITR& block_bucket_itr, verify_info_data& verify_info,
+                                          const bool partial) {
     const auto block_size = block_bucket_itr->size;
     const auto bucket_id = block_bucket_itr->bucket_id;
     const auto height = block_bucket_itr->height;
 
-    auto block_data = read_bucket(get_self(), bucket_id, BLOCK_CHUNK, verify_info.processed_position, block_size);
-    eosio::datastream<const char*> block_stream(block_data.data(), block_data.size());
+    bucket_reader reader(get_self(), bucket_id, BLOCK_CHUNK, verify_info.processed_position, partial);
+    size_t position = 0;
 
     auto hash = block_bucket_itr->hash;
     // verify header
     if (verify_info.processed_position == 0) {
+        // the offsets of a previous verification may not match the current chunks
+        tx_offset_table _tx_offset(get_self(), bucket_id);
+        _tx_offset.remove();
+
+        // header + num_transactions varint (at most 9 bytes)
+        if (!reader.load(std::min<uint64_t>(BLOCK_HEADER_SIZE + 9, block_size))) {
+            if (partial) {
+                return std::nullopt;
+            }
+            return "missing_block_data";
+        }
+        eosio::datastream<const char*> block_stream(reader.data.data(), reader.data.size());
         bitcoin::core::block_header block_header;
         block_stream >> block_header;
 
@@ -517,45 +794,78 @@ optional<string> block_sync::check_merkle(const ITR& block_bucket_itr, verify_in
         verify_info.header_merkle = bitcoin::le_checksum256_from_uint(block_header.merkle);
         verify_info.timestamp = block_header.timestamp;
         verify_info.bits = block_header.bits;
+        position = block_stream.tellp();
     }
 
     // deserialization transaction
     utxo_manage::config_table _config(UTXO_MANAGE_CONTRACT, UTXO_MANAGE_CONTRACT.value);
     auto config = _config.get();
     auto num_txs_per_verification = config.num_txs_per_verification;
+    auto verification_budget = config.verification_budget.value_or(0);
     auto pending_transactions = verify_info.num_transactions - verify_info.processed_transactions;
-    auto rows = num_txs_per_verification;
+    uint64_t rows = verification_budget > 0 ? pending_transactions : num_txs_per_verification;
     if (rows > pending_transactions) {
         rows = pending_transactions;
     }
-    std::vector<bitcoin::core::transaction> transactions;
-    transactions.reserve(rows);
+    std::vector<bitcoin::core::transaction_view> transactions;
+    transactions.reserve(std::min<uint64_t>(rows, num_txs_per_verification));
+    std::optional<bitcoin::core::transaction> coinbase;
+    uint64_t weight = 0;
     for (auto i = 0; i < rows; i++) {
-        // Coinbase needs to obtain witness data
-        bool allow_witness = verify_info.processed_position == 0 && i == 0;
-        bitcoin::core::transaction transaction(&block_data, allow_witness);
+        if (!reader.load_transaction(position)) {
+            // wait for the next chunk
+            if (partial) {
+                rows = i;
+                break;
+            }
+            return "missing_block_data";
+        }
+        eosio::datastream<const char*> block_stream(reader.data.data(), reader.data.size());
+        block_stream.seekp(position);
+        bitcoin::core::transaction_view transaction(&reader.data);
         block_stream >> transaction;
 
+        // stop before exceeding the budget, at least one transaction is verified
+        if (verification_budget > 0) {
+            // witness transactions are hashed twice (txid and wtxid)
+            auto hashed_bytes = (transaction.to - transaction.from) * (transaction.has_witness ? 2 : 1);
+            auto tx_weight = hashed_bytes * WEIGHT_PER_HASHED_BYTE + transaction.num_inputs * WEIGHT_PER_INPUT
+                             + transaction.num_outputs * WEIGHT_PER_OUTPUT;
+            if (i > 0 && weight + tx_weight > verification_budget) {
+                rows = i;
+                break;
+            }
+            weight += tx_weight;
+        }
+
+        // Coinbase needs to obtain witness data
+        if (verify_info.processed_transactions == 0 && i == 0) {
+            block_stream.seekp(position);
+            coinbase.emplace(&reader.data, /*allow_witness=*/true);
+            block_stream >> *coinbase;
+        }
+        position = block_stream.tellp();
+
         auto err_msg = check_transaction(transaction);
         if (err_msg.has_value()) {
             return err_msg;
         }
 
-        transactions.emplace_back(std::move(transaction));
+        transactions.emplace_back(transaction);
     }
 
     if (!verify_info.has_witness) {
         verify_info.has_witness = std::any_of(transactions.cbegin(), transactions.cend(), [](const auto& trx) {
-            return trx.witness.size() > 0;
+            return trx.has_witness;
         });
     }
 
     // check witness ?
-    if (verify_info.processed_position == 0 && transactions.front().inputs.size() > 0) {
-        if (!transactions.front().is_coinbase()) {
+    if (coinbase.has_value() && coinbase->inputs.size() > 0) {
+        if (!coinbase->is_coinbase()) {
             return "coinbase_missing";
         }
-        const auto& cbtrx = transactions.front();
+        const auto& cbtrx = *coinbase;
         verify_info.witness_reserve_value = cbtrx.get_witness_reserve_value();
         if (cbtrx.witness.size() > 0 && !verify_info.witness_reserve_value.has_value()) {
             return "bad-witness-nonce-size";
@@ -569,42 +879,42 @@ optional<string> block_sync::check_merkle(const ITR& block_bucket_itr, verify_in
     auto need_witness_check
         = verify_info.witness_reserve_value.has_value() && verify_info.witness_commitment.has_value();
 
-    // obtain relay merkle
-    bool mutated;
-    bitcoin::uint256_t header_merkle = bitcoin::core::generate_header_merkle(transactions, &mutated);
-    if (mutated) {
-        return "bad_txns_duplicate";
-    }
-
-    bitcoin::uint256_t witness_merkle;
-    if (need_witness_check) {
-        witness_merkle = bitcoin::core::generate_witness_merkle(transactions, /*mutated=*/nullptr);
-    }
-
-    // calculate to the same layer
-    if (verify_info.num_transactions > num_txs_per_verification && rows != num_txs_per_verification) {
-        uint8_t current_layer = static_cast<uint8_t>(std::ceil(std::log2(rows)));
-        vector<bitcoin::uint256_t> cur_hashes;
-        cur_hashes.reserve(2);
-        for (; current_layer < config.num_merkle_layer; current_layer++) {
-            cur_hashes = {header_merkle, header_merkle};
-            header_merkle = bitcoin::generate_merkle_root(cur_hashes);
-            if (need_witness_check) {
-                cur_hashes = {witness_merkle, witness_merkle};
-                witness_merkle = bitcoin::generate_merkle_root(cur_hashes);
-            }
+    // restore the merkle frontier of the processed transactions
+    bitcoin::merkle_frontier header_frontier = restore_merkle_frontier(verify_info.header_merkle_frontier,
+                                                                       verify_info.processed_transactions);
+    bitcoin::merkle_frontier witness_frontier = restore_merkle_frontier(verify_info.witness_merkle_frontier,
+                                                                        verify_info.processed_transactions);
+    std::vector<char> buffer;
+    for (auto i = 0; i < transactions.size(); i++) {
+        header_frontier.append(transactions[i].merkle_hash(buffer));
+        if (need_witness_check) {
+            // coinbase transaction has a zero hash
+            const bool is_coinbase = verify_info.processed_transactions == 0 && i == 0;
+            witness_frontier.append(is_coinbase ? bitcoin::uint256_t(0) : transactions[i].hash());
         }
     }
+    if (header_frontier.mutated) {
+        return "bad_txns_duplicate";
+    }
 
-    // save sub merkle
-    verify_info.relay_header_merkle.emplace_back(bitcoin::le_checksum256_from_uint(header_merkle));
+    // save merkle frontier
+    save_merkle_frontier(header_frontier, verify_info.header_merkle_frontier);
     if (need_witness_check) {
-        verify_info.relay_witness_merkle.emplace_back(bitcoin::le_checksum256_from_uint(witness_merkle));
+        save_merkle_frontier(witness_frontier, verify_info.witness_merkle_frontier);
     }
 
     // save processed position
     verify_info.processed_transactions += rows;
-    verify_info.processed_position += block_stream.tellp();
+    verify_info.processed_position += position;
+
+    // the next round starts a new parse range
+    if (rows > 0 && verify_info.processed_transactions < verify_info.num_transactions) {
+        tx_offset_table _tx_offset(get_self(), bucket_id);
+        auto tx_offsets = _tx_offset.get_or_default();
+        tx_offsets.offsets.push_back(
+            {.transaction = verify_info.processed_transactions, .position = verify_info.processed_position});
+        _tx_offset.set(tx_offsets, get_self());
+    }
 
     // check data size
     if (verify_info.num_transactions == verify_info.processed_transactions
@@ -621,15 +931,19 @@ optional<string> block_sync::check_merkle(const ITR& block_bucket_itr, verify_in
     if (verify_info.num_transactions == verify_info.processed_transactions
         && verify_info.processed_position == block_size) {
         // verify header merkle
-        auto header_merkle_root = bitcoin::generate_merkle_root(verify_info.relay_header_merkle);
+        bool mutated;
+        auto header_merkle_root = header_frontier.root(&mutated);
+        if (mutated) {
+            return "bad_txns_duplicate";
+        }
         if (header_merkle_root != bitcoin::le_uint_from_checksum256(verify_info.header_merkle)) {
             return "merkle_invalid";
         }
 
         // verify witness merkle
         if (need_witness_check) {
-            auto witness_merkle_root = bitcoin::core::generate_witness_merkle(verify_info.relay_witness_merkle,
-                                                                              *verify_info.witness_reserve_value);
+            auto witness_merkle_root = bitcoin::core::generate_witness_commitment(witness_frontier.root(),
+                                                                                  *verify_info.witness_reserve_value);
             if (witness_merkle_root != bitcoin::le_uint_from_checksum256(*verify_info.witness_commitment)) {
                 return "witness_merkle_invalid";
             }
@@ -639,6 +953,47 @@ optional<string> block_sync::check_merkle(const ITR& block_bucket_itr, verify_in
     }
     return std::nullopt;
 }
+//@private
+optional<bitcoin::core::block> block_sync::get_header_ancestor(const uint64_t height,
+                                                               const optional<checksum256> hash) {
+    // the height alone is ambiguous among forks of [blockheaders]
+    if (hash.has_value()) {
+        block_header_table _block_header(BLOCK_SYNC_CONTRACT, height);
+        auto block_header_idx = _block_header.get_index<"byhash"_n>();
+        auto block_header_itr = block_header_idx.find(*hash);
+        if (block_header_itr != block_header_idx.end()) {
+            return bitcoin::core::block{.height = height,
+                                        .hash = block_header_itr->hash,
+                                        .previous_block_hash = block_header_itr->previous_block_hash,
+                                        .cumulative_work = block_header_itr->cumulative_work,
+                                        .timestamp = block_header_itr->timestamp,
+                                        .bits = block_header_itr->bits};
+        }
+    }
+    return utxo_manage::get_ancestor(height, hash);
+}
+
+//@private
+bitcoin::merkle_frontier block_sync::restore_merkle_frontier(const std::vector<checksum256>& roots,
+                                                             const uint64_t count) {
+    bitcoin::merkle_frontier frontier;
+    frontier.count = count;
+    frontier.roots.reserve(roots.size() + 1);
+    for (const auto& root : roots) {
+        frontier.roots.emplace_back(bitcoin::le_uint_from_checksum256(root));
+    }
+    return frontier;
+}
+
+//@private
+void block_sync::save_merkle_frontier(const bitcoin::merkle_frontier& frontier, std::vector<checksum256>& roots) {
+    roots.clear();
+    roots.reserve(frontier.roots.size());
+    for (const auto& root : frontier.roots) {
+        roots.emplace_back(bitcoin::le_checksum256_from_uint(root));
+    }
+}
+
 //@private
 template <typename T, typename ITR>
 block_sync::verify_block_result block_sync::check_fail(T& _block_bucket, const ITR block_bucket_itr,
@@ -687,3 +1042,119 @@ uint64_t block_sync::next_bucket_id() {
     _global_id.set(global_id, get_self());
     return global_id.bucket_id;
 }
+
+uint64_t block_sync::next_chunk_data_id() {
+    global_id_row global_id = _global_id.get_or_default();
+    global_id.chunk_data_id = global_id.chunk_data_id.value_or(0) + 1;
+    _global_id.set(global_id, get_self());
+    return global_id.chunk_data_id.value();
+}
+
+// returns the id of [chunk.data] holding data, shared with other buckets if the content is the same
+uint64_t block_sync::acquire_chunk_data(const char* data, const uint32_t size) {
+    auto hash = eosio::sha256(data, size);
+
+    chunk_ref_table _chunk_ref(get_self(), get_self().value);
+    auto chunk_ref_idx = _chunk_ref.get_index<"byhash"_n>();
+    auto chunk_ref_itr = chunk_ref_idx.find(hash);
+    if (chunk_ref_itr != chunk_ref_idx.end()) {
+        check(chunk_ref_itr->size == size, "blksync.xsat::acquire_chunk_data: chunk hash collision");
+        chunk_ref_idx.modify(chunk_ref_itr, same_payer, [&](auto& row) { row.num_refs++; });
+        return chunk_ref_itr->id;
+    }
+
+    auto data_id = next_chunk_data_id();
+    eosio::internal_use_do_not_use::db_store_i64(get_self().value, CHUNK_DATA.value, get_self().value, data_id, data,
+                                                 size);
+    _chunk_ref.emplace(get_self(), [&](auto& row) {
+        row.id = data_id;
+        row.hash = hash;
+        row.size = size;
+        row.num_refs = 1;
+    });
+    return data_id;
+}
+
+// drops the reference of a bucket chunk, erasing the data once no bucket references it
+void block_sync::release_chunk_data(const uint64_t bucket_id, const chunk_offset& chunk) {
+    if (chunk.data_id == 0) {
+        auto iter = eosio::internal_use_do_not_use::db_find_i64(get_self().value, bucket_id, BLOCK_CHUNK.value,
+                                                                chunk.chunk_id);
+        if (iter >= 0) {
+            eosio::internal_use_do_not_use::db_remove_i64(iter);
+        }
+        return;
+    }
+
+    chunk_ref_table _chunk_ref(get_self(), get_self().value);
+    auto chunk_ref_itr
+        = _chunk_ref.require_find(chunk.data_id, "blksync.xsat::release_chunk_data: [chunkrefs] does not exists");
+    if (chunk_ref_itr->num_refs > 1) {
+        _chunk_ref.modify(chunk_ref_itr, same_payer, [&](auto& row) { row.num_refs--; });
+        return;
+    }
+    _chunk_ref.erase(chunk_ref_itr);
+    auto iter = eosio::internal_use_do_not_use::db_find_i64(get_self().value, get_self().value, CHUNK_DATA.value,
+                                                            chunk.data_id);
+    if (iter >= 0) {
+        eosio::internal_use_do_not_use::db_remove_i64(iter);
+    }
+}
+
+void block_sync::erase_bucket_chunks(const uint64_t bucket_id) {
+    chunk_offset_table _chunk_offset(get_self(), bucket_id);
+    if (_chunk_offset.exists()) {
+        for (const auto& chunk : _chunk_offset.get().chunks) {
+            release_chunk_data(bucket_id, chunk);
+        }
+        _chunk_offset.remove();
+    }
+
+    tx_offset_table _tx_offset(get_self(), bucket_id);
+    _tx_offset.remove();
+
+    // chunks uploaded before [chunkoffsets] existed
+    auto iter = eosio::internal_use_do_not_use::db_lowerbound_i64(get_self().value, bucket_id, BLOCK_CHUNK.value, 0);
+    while (iter >= 0) {
+        uint64_t ignored;
+        auto next_iter = eosio::internal_use_do_not_use::db_next_i64(iter, &ignored);
+        eosio::internal_use_do_not_use::db_remove_i64(iter);
+        iter = next_iter;
+    }
+}
+
+// digest of the chunk contents of the bucket, none if any chunk is not content addressed
+std::optional<checksum256> block_sync::compute_bucket_digest(const uint64_t bucket_id) {
+    chunk_offset_table _chunk_offset(get_self(), bucket_id);
+    if (!_chunk_offset.exists()) {
+        return std::nullopt;
+    }
+    // data_id identifies the content, the same data_id is never reused for other content
+    const auto chunks = _chunk_offset.get().chunks;
+    for (const auto& chunk : chunks) {
+        if (chunk.data_id == 0) {
+            return std::nullopt;
+        }
+    }
+    auto data = eosio::pack(chunks);
+    return eosio::sha256(data.data(), data.size());
+}
+
+block_sync::chunk_offset_row block_sync::get_chunk_offsets(const uint64_t bucket_id,
+                                                           const std::set<uint16_t>& chunk_ids) {
+    chunk_offset_table _chunk_offset(get_self(), bucket_id);
+    if (_chunk_offset.exists()) {
+        return _chunk_offset.get();
+    }
+
+    // rebuild offsets for buckets uploaded before [chunkoffsets] existed
+    chunk_offset_row chunk_offsets;
+    for (const auto chunk_id : chunk_ids) {
+        auto iter
+            = eosio::internal_use_do_not_use::db_find_i64(get_self().value, bucket_id, BLOCK_CHUNK.value, chunk_id);
+        if (iter >= 0) {
+            chunk_offsets.set_chunk(chunk_id, eosio::internal_use_do_not_use::db_get_i64(iter, nullptr, 0), 0);
+        }
+    }
+    return chunk_offsets;
+}
@@ -6,6 +6,7 @@
 #include <eosio/crypto.hpp>
 #include <eosio/binary_extension.hpp>
 #include <bitcoin/core/transaction.hpp>
+#include <bitcoin/core/chain.hpp>
 #include "../internal/utils.hpp"
 
 using namespace eosio;
@@ -65,20 +66,44 @@ class [[eosio::contract("blksync.xsat")]] block_sync : public contract {
      * ### params
      *
      * - `{uint64_t} bucket_id` - latest bucket_id
+     * - `{binary_extension<uint64_t>} chunk_data_id` - latest chunk_data_id
      *
      * ### example
      *
      * ```json
      * {
-     *   "bucket_id": 1
+     *   "bucket_id": 1,
+     *   "chunk_data_id": 11
      * }
      * ```
      */
     struct [[eosio::table]] global_id_row {
         uint64_t bucket_id;
+        binary_extension<uint64_t> chunk_data_id;
     };
     typedef eosio::singleton<"globalid"_n, global_id_row> global_id_table;
 
+    /**
+     * ## TABLE `config`
+     *
+     * ### scope `get_self()`
+     * ### params
+     *
+     * - `{bool} require_headers` - whether `initbucket` requires the block header to be pushed by `pushheaders`
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "require_headers": true
+     * }
+     * ```
+     */
+    struct [[eosio::table]] config_row {
+        bool require_headers = false;
+    };
+    typedef eosio::singleton<"config"_n, config_row> config_table;
+
     /**
      * ## STRUCT `verify_info_data`
      *
@@ -92,8 +117,8 @@ class [[eosio::contract("blksync.xsat")]] block_sync : public contract {
      * - `{std::optional<checksum256>}` - witness commitment in the block
      * - `{bool} has_witness` - whether any of the transactions in the block contains witness
      * - `{checksum256} header_merkle` - the merkle root of the block
-     * - `{std::vector<checksum256>} relay_header_merkle` - check header merkle relay data
-     * - `{std::vector<checksum256>} relay_witness_merkle` - check witness merkle relay data
+     * - `{std::vector<checksum256>} header_merkle_frontier` - pending subtree roots of the processed transaction hashes, one per set bit of `processed_transactions`, highest level first
+     * - `{std::vector<checksum256>} witness_merkle_frontier` - pending subtree roots of the processed witness transaction hashes
      * - `{uint64_t} num_transactions` - the number of transactions in the block
      * - `{uint64_t} processed_position` - the location of the block that has been resolved
      * - `{uint64_t} processed_transactions` - the number of processed transactions
@@ -114,17 +139,11 @@ class [[eosio::contract("blksync.xsat")]] block_sync : public contract {
      *   "witness_commitment": "aeaa22969e5aac88afd1ac14b19a3ad3a58f5eb0dd151ddddfc749297ebfb020",
      *   "has_witness": 1,
      *   "header_merkle": "f3f07d3e4636fa1ae5300b3bc148c361beafd7b3309d30b7ba136d0e59a9a0e5",
-     *   "relay_header_merkle": [
-     *      "d1c9861b0d129b34bb6b733c624bbe0a9b10ff01c6047dced64586ef584987f4",
-     *      "bd95f641a29379f0b5a26961de4bb36bd9568a67ca0615be3fb0a28152ff1806",
-     *      "667eb5d36c67667ae4f10bd30a62e3797e8700e1fbb5e3f754a7526f2b7db1e2",
-     *      "5193ac78b5ef8f570ed24946fbcb96d71284faa27b86296093a93eb5c1cfac06"
+     *   "header_merkle_frontier": [
+     *      "d1c9861b0d129b34bb6b733c624bbe0a9b10ff01c6047dced64586ef584987f4"
      *   ],
-     *   "relay_witness_merkle": [
-     *      "8a080509ebf6baca260d466c2669200d9b4de750f6a190382c4e8ab6ab6859db",
-     *      "d65d4261be51ca1193e718a6f0cfe6415b6f122f4c3df87861e7452916b45d78",
-     *      "95aa96164225b76afa32a9b2903241067b0ea71228cc2d51b9321148c4e37dd3",
-     *      "0dfca7530a6e950ecdec67c60e5d9574404cc97b333a4e24e3cf2eadd5eb76bd"
+     *   "witness_merkle_frontier": [
+     *      "8a080509ebf6baca260d466c2669200d9b4de750f6a190382c4e8ab6ab6859db"
      *   ],
      *   "num_transactions": 4899,
      *   "processed_transactions": 4096,
@@ -143,8 +162,8 @@ class [[eosio::contract("blksync.xsat")]] block_sync : public contract {
         std::optional<checksum256> witness_commitment;
         bool has_witness;
         checksum256 header_merkle;
-        std::vector<checksum256> relay_header_merkle;
-        std::vector<checksum256> relay_witness_merkle;
+        std::vector<checksum256> header_merkle_frontier;
+        std::vector<checksum256> witness_merkle_frontier;
         uint64_t num_transactions = 0;
         uint64_t processed_transactions = 0;
         uint64_t processed_position = 0;
@@ -198,17 +217,11 @@ class [[eosio::contract("blksync.xsat")]] block_sync : public contract {
      *       "witness_commitment": "aeaa22969e5aac88afd1ac14b19a3ad3a58f5eb0dd151ddddfc749297ebfb020",
      *       "has_witness": 1,
      *       "header_merkle": "f3f07d3e4636fa1ae5300b3bc148c361beafd7b3309d30b7ba136d0e59a9a0e5",
-     *       "relay_header_merkle": [
-     *          "d1c9861b0d129b34bb6b733c624bbe0a9b10ff01c6047dced64586ef584987f4",
-     *          "bd95f641a29379f0b5a26961de4bb36bd9568a67ca0615be3fb0a28152ff1806",
-     *          "667eb5d36c67667ae4f10bd30a62e3797e8700e1fbb5e3f754a7526f2b7db1e2",
-     *          "5193ac78b5ef8f570ed24946fbcb96d71284faa27b86296093a93eb5c1cfac06"
+     *       "header_merkle_frontier": [
+     *          "d1c9861b0d129b34bb6b733c624bbe0a9b10ff01c6047dced64586ef584987f4"
      *       ],
-     *       "relay_witness_merkle": [
-     *           "8a080509ebf6baca260d466c2669200d9b4de750f6a190382c4e8ab6ab6859db",
-     *           "d65d4261be51ca1193e718a6f0cfe6415b6f122f4c3df87861e7452916b45d78",
-     *           "95aa96164225b76afa32a9b2903241067b0ea71228cc2d51b9321148c4e37dd3",
-     *           "0dfca7530a6e950ecdec67c60e5d9574404cc97b333a4e24e3cf2eadd5eb76bd"
+     *       "witness_merkle_frontier": [
+     *           "8a080509ebf6baca260d466c2669200d9b4de750f6a190382c4e8ab6ab6859db"
      *       ],
      *       "num_transactions": 4899,
      *       "processed_transactions": 4096,
@@ -250,6 +263,136 @@ class [[eosio::contract("blksync.xsat")]] block_sync : public contract {
         eosio::indexed_by<"byblockid"_n, const_mem_fun<block_bucket_row, checksum256, &block_bucket_row::by_block_id>>>
         block_bucket_table;
 
+    /**
+     * ## STRUCT `tx_offset`
+     *
+     * ### params
+     *
+     * - `{uint64_t} transaction` - index of the first transaction of a verification round
+     * - `{uint64_t} position` - start offset of the transaction in the block
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "transaction": 2048,
+     *   "position": 597322
+     * }
+     * ```
+     */
+    struct tx_offset {
+        uint64_t transaction;
+        uint64_t position;
+    };
+
+    /**
+     * ## TABLE `merklecache`
+     *
+     * ### scope `height`
+     * ### params
+     *
+     * - `{uint64_t} id` - primary id
+     * - `{checksum256} hash` - block hash
+     * - `{checksum256} digest` - digest of the bucket chunks that passed the merkle verification
+     * - `{verify_info_data} verify_info` - verify_info of the bucket when the merkle verification passed
+     * - `{binary_extension<std::vector<tx_offset>>} tx_offsets` - `txoffsets` of the bucket, copied to the buckets
+     * that reuse the verification @see table `txoffsets`
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "id": 0,
+     *   "hash": "00000000000000000001d2cbad2209f51143679b6797aef393a45e82eb88a9ae",
+     *   "digest": "9b3ffa7d9a7b8b1dd9c6c5cf2ab3d7f0a6f8b2c7e5d4a3b2c1d0e9f8a7b6c5d4",
+     *   "verify_info": {...},
+     *   "tx_offsets": [{
+     *       "transaction": 2048,
+     *       "position": 597322
+     *   }]
+     * }
+     * ```
+     */
+    struct [[eosio::table]] merkle_cache_row {
+        uint64_t id;
+        checksum256 hash;
+        checksum256 digest;
+        verify_info_data verify_info;
+        binary_extension<std::vector<tx_offset>> tx_offsets;
+        uint64_t primary_key() const { return id; }
+        checksum256 by_digest() const { return compute_merkle_cache_key(hash, digest); }
+    };
+    typedef eosio::multi_index<
+        "merklecache"_n, merkle_cache_row,
+        eosio::indexed_by<"bydigest"_n, const_mem_fun<merkle_cache_row, checksum256, &merkle_cache_row::by_digest>>>
+        merkle_cache_table;
+
+    /**
+     * ## TABLE `verifymodes`
+     *
+     * ### scope `get_self()`
+     * ### params
+     *
+     * - `{name} synchronizer` - synchronizer account
+     * - `{bool} verify_on_upload` - whether `pushchunk` verifies the merkle of the contiguous uploaded chunks
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "synchronizer": "alice",
+     *   "verify_on_upload": true
+     * }
+     * ```
+     */
+    struct [[eosio::table]] verify_mode_row {
+        name synchronizer;
+        bool verify_on_upload;
+        uint64_t primary_key() const { return synchronizer.value; }
+    };
+    typedef eosio::multi_index<"verifymodes"_n, verify_mode_row> verify_mode_table;
+
+    /**
+     * ## TABLE `blockheaders`
+     *
+     * ### scope `height`
+     * ### params
+     *
+     * - `{uint64_t} id` - primary id
+     * - `{checksum256} hash` - block hash
+     * - `{checksum256} previous_block_hash` - hash in internal byte order of the previous block’s header
+     * - `{checksum256} cumulative_work` - the cumulative workload of the block
+     * - `{uint32_t} timestamp` - block timestamp
+     * - `{uint32_t} bits` - the difficulty target of the block
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "id": 0,
+     *   "hash": "00000000000000000001d2cbad2209f51143679b6797aef393a45e82eb88a9ae",
+     *   "previous_block_hash": "00000000000000000002bf1e60049e942ac34b728911adda77d704cc8401e84b",
+     *   "cumulative_work": "0000000000000000000000000000000000000000760a1c0decbd5f695365789e",
+     *   "timestamp": 1713970312,
+     *   "bits": 386085339
+     * }
+     * ```
+     */
+    struct [[eosio::table]] block_header_row {
+        uint64_t id;
+        checksum256 hash;
+        checksum256 previous_block_hash;
+        checksum256 cumulative_work;
+        uint32_t timestamp;
+        uint32_t bits;
+        uint64_t primary_key() const { return id; }
+        checksum256 by_hash() const { return hash; }
+    };
+    typedef eosio::multi_index<
+        "blockheaders"_n, block_header_row,
+        eosio::indexed_by<"byhash"_n, const_mem_fun<block_header_row, checksum256, &block_header_row::by_hash>>>
+        block_header_table;
+
     /**
      * ## TABLE `passedindexs`
      *
@@ -353,6 +496,187 @@ class [[eosio::contract("blksync.xsat")]] block_sync : public contract {
     };
     typedef eosio::multi_index<"block.chunk"_n, block_chunk_row> block_chunk_table;
 
+    /**
+     * ## TABLE `chunk.data`
+     *
+     * ### scope `get_self()`
+     * ### params
+     *
+     * - `{std::vector<char>} data` - chunk data shared by all buckets that uploaded the same content, the primary key
+     * is the `id` of [chunkrefs]
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "data": ""
+     * }
+     * ```
+     */
+    struct [[eosio::table]] chunk_data_row {
+        std::vector<char> data;
+    };
+    typedef eosio::multi_index<"chunk.data"_n, chunk_data_row> chunk_data_table;
+
+    /**
+     * ## TABLE `chunkrefs`
+     *
+     * ### scope `get_self()`
+     * ### params
+     *
+     * - `{uint64_t} id` - primary key, the primary key of [chunk.data]
+     * - `{checksum256} hash` - sha256 of the chunk data
+     * - `{uint32_t} size` - chunk size
+     * - `{uint32_t} num_refs` - number of bucket chunks referencing the data
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "id": 1,
+     *   "hash": "6f1e1b4a2e0c5c4b8c3c8f8a5e6d0f0b9d2f3b3c1e4a5d6b7c8d9e0f1a2b3c4d",
+     *   "size": 262144,
+     *   "num_refs": 2
+     * }
+     * ```
+     */
+    struct [[eosio::table]] chunk_ref_row {
+        uint64_t id;
+        checksum256 hash;
+        uint32_t size;
+        uint32_t num_refs;
+        uint64_t primary_key() const { return id; }
+        checksum256 by_hash() const { return hash; }
+    };
+    typedef eosio::multi_index<
+        "chunkrefs"_n, chunk_ref_row,
+        eosio::indexed_by<"byhash"_n, const_mem_fun<chunk_ref_row, checksum256, &chunk_ref_row::by_hash>>>
+        chunk_ref_table;
+
+    /**
+     * ## STRUCT `chunk_offset`
+     *
+     * ### params
+     *
+     * - `{uint8_t} chunk_id` - chunk id
+     * - `{uint32_t} offset` - start offset of the chunk in the block
+     * - `{uint32_t} size` - chunk size
+     * - `{uint64_t} data_id` - id of [chunk.data], 0 if the chunk is stored in [block.chunk] of the bucket
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "chunk_id": 1,
+     *   "offset": 256000,
+     *   "size": 256000,
+     *   "data_id": 2
+     * }
+     * ```
+     */
+    struct chunk_offset {
+        uint8_t chunk_id;
+        uint32_t offset;
+        uint32_t size;
+        uint64_t data_id;
+    };
+
+    /**
+     * ## TABLE `chunkoffsets`
+     *
+     * ### scope `bucket_id`
+     * ### params
+     *
+     * - `{std::vector<chunk_offset>} chunks` - uploaded chunks sorted by chunk_id, @see struct `chunk_offset`
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "chunks": [{
+     *       "chunk_id": 0,
+     *       "offset": 0,
+     *       "size": 256000,
+     *       "data_id": 1
+     *   }, {
+     *       "chunk_id": 1,
+     *       "offset": 256000,
+     *       "size": 256000,
+     *       "data_id": 2
+     *   }]
+     * }
+     * ```
+     */
+    struct [[eosio::table]] chunk_offset_row {
+        std::vector<chunk_offset> chunks;
+
+        void set_chunk(const uint8_t chunk_id, const uint32_t size, const uint64_t data_id) {
+            auto itr = std::lower_bound(chunks.begin(), chunks.end(), chunk_id,
+                                        [](const chunk_offset &chunk, uint8_t id) { return chunk.chunk_id < id; });
+            if (itr != chunks.end() && itr->chunk_id == chunk_id) {
+                itr->size = size;
+                itr->data_id = data_id;
+            } else {
+                itr = chunks.insert(itr, chunk_offset{.chunk_id = chunk_id, .size = size, .data_id = data_id});
+            }
+            update_offsets(itr - chunks.begin());
+        }
+
+        const chunk_offset *find_chunk(const uint8_t chunk_id) const {
+            auto itr = std::lower_bound(chunks.begin(), chunks.end(), chunk_id,
+                                        [](const chunk_offset &chunk, uint8_t id) { return chunk.chunk_id < id; });
+            return itr != chunks.end() && itr->chunk_id == chunk_id ? &*itr : nullptr;
+        }
+
+        void erase_chunk(const uint8_t chunk_id) {
+            auto itr = std::lower_bound(chunks.begin(), chunks.end(), chunk_id,
+                                        [](const chunk_offset &chunk, uint8_t id) { return chunk.chunk_id < id; });
+            if (itr != chunks.end() && itr->chunk_id == chunk_id) {
+                itr = chunks.erase(itr);
+                update_offsets(itr - chunks.begin());
+            }
+        }
+
+        uint64_t total_size() const { return chunks.empty() ? 0 : chunks.back().offset + chunks.back().size; }
+
+        void update_offsets(size_t from) {
+            for (auto i = from; i < chunks.size(); i++) {
+                chunks[i].offset = i == 0 ? 0 : chunks[i - 1].offset + chunks[i - 1].size;
+            }
+        }
+    };
+    typedef eosio::singleton<"chunkoffsets"_n, chunk_offset_row> chunk_offset_table;
+
+    /**
+     * ## TABLE `txoffsets`
+     *
+     * > Where each verification round after the first one started, utxomng.xsat parses the rounds as separate
+     * ranges. Rewritten when the verification of the bucket restarts.
+     *
+     * ### scope `bucket_id`
+     * ### params
+     *
+     * - `{std::vector<tx_offset>} offsets` - offsets sorted by transaction, @see struct `tx_offset`
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "offsets": [{
+     *       "transaction": 2048,
+     *       "position": 597322
+     *   }, {
+     *       "transaction": 4096,
+     *       "position": 1197889
+     *   }]
+     * }
+     * ```
+     */
+    struct [[eosio::table]] tx_offset_row {
+        std::vector<tx_offset> offsets;
+    };
+    typedef eosio::singleton<"txoffsets"_n, tx_offset_row> tx_offset_table;
+
     /**
      * ## STRUCT `verify_block_result`
      *
@@ -378,6 +702,28 @@ class [[eosio::contract("blksync.xsat")]] block_sync : public contract {
         checksum256 block_hash;
     };
 
+    /**
+     * ## STRUCT `chunk_data`
+     *
+     * ### params
+     *
+     * - `{uint8_t} chunk_id` - chunk id
+     * - `{std::vector<char>} data` - chunk data
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "chunk_id": 0,
+     *   "data": ""
+     * }
+     * ```
+     */
+    struct chunk_data {
+        uint8_t chunk_id;
+        std::vector<char> data;
+    };
+
     /**
      * ## ACTION `consensus`
      *
@@ -420,12 +766,78 @@ class [[eosio::contract("blksync.xsat")]] block_sync : public contract {
     [[eosio::action]]
     void delchunks(const uint64_t bucket_id);
 
+    /**
+     * ## ACTION `erase`
+     *
+     * - **authority**: `utxomng.xsat`
+     *
+     * > Erase the `merklecache` and `blockheaders` of an irreversible height, including the rows of competing blocks
+     * and of headers that no bucket followed
+     *
+     * ### params
+     *
+     * - `{uint64_t} height` - irreversible block height
+     *
+     * ### example
+     *
+     * ```bash
+     * $ cleos push action blksync.xsat erase '[840000]' -p utxomng.xsat
+     * ```
+     */
+    [[eosio::action]]
+    void erase(const uint64_t height);
+
+    /**
+     * ## ACTION `config`
+     *
+     * - **authority**: `get_self()`
+     *
+     * > Update the configuration
+     *
+     * ### params
+     *
+     * - `{bool} require_headers` - whether `initbucket` requires the block header to be pushed by `pushheaders`
+     *
+     * ### example
+     *
+     * ```bash
+     * $ cleos push action blksync.xsat config '[true]' -p blksync.xsat
+     * ```
+     */
+    [[eosio::action]]
+    void config(const bool require_headers);
+
+    /**
+     * ## ACTION `pushheaders`
+     *
+     * - **authority**: `synchronizer`
+     *
+     * > Upload consecutive block headers before the block data. Each header is checked for version, proof of work,
+     * difficulty bits and parent linkage, so that invalid blocks are rejected before their chunks are uploaded. Each
+     * saved header is charged a `PUSH_CHUNK` fee
+     *
+     * ### params
+     *
+     * - `{name} synchronizer` - synchronizer account
+     * - `{uint64_t} height` - block height of the first header
+     * - `{std::vector<char>} headers` - serialized 80-byte block headers, each one the parent of the next
+     *
+     * ### example
+     *
+     * ```bash
+     * $ cleos push action blksync.xsat pushheaders '["alice", 840000, "00e05f2a..."]' -p alice
+     * ```
+     */
+    [[eosio::action]]
+    void pushheaders(const name &synchronizer, const uint64_t height, const std::vector<char> &headers);
+
     /**
      * ## ACTION `initbucket`
      *
      * - **authority**: `synchronizer`
      *
-     * > Initialize the block information to be uploaded
+     * > Initialize the block information to be uploaded, the block header must be pushed first when
+     * `require_headers` is enabled
      *
      * ### params
      *
@@ -451,7 +863,8 @@ class [[eosio::contract("blksync.xsat")]] block_sync : public contract {
      *
      * - **authority**: `synchronizer`
      *
-     * > Upload block shard data
+     * > Upload block shard data. With `verify_on_upload` enabled, the complete transactions of the contiguous uploaded
+     * chunks are verified right away and an extra verify fee is charged, @see action `verifymode`
      *
      * ### params
      *
@@ -471,12 +884,57 @@ class [[eosio::contract("blksync.xsat")]] block_sync : public contract {
     void pushchunk(const name &synchronizer, const uint64_t height, const checksum256 &hash, const uint8_t chunk_id,
                    const eosio::ignore<std::vector<char>> &data);
 
+    /**
+     * ## ACTION `pushchunks`
+     *
+     * - **authority**: `synchronizer`
+     *
+     * > Upload multiple block shards at once, the fee is the same as uploading them one by one
+     *
+     * ### params
+     *
+     * - `{name} synchronizer` - synchronizer account
+     * - `{uint64_t} height` - block height
+     * - `{checksum256} hash` - block hash
+     * - `{std::vector<chunk_data>} chunks` - chunks to be uploaded
+     *
+     * ### example
+     *
+     * ```bash
+     * $ cleos push action blksync.xsat pushchunks '["alice", 840000, "0000000000000000000320283a032748cef8227873ff4872689bf23f1cda83a5", [{"chunk_id": 0, "data": ""}, {"chunk_id": 1, "data": ""}]]' -p alice
+     * ```
+     */
+    [[eosio::action]]
+    void pushchunks(const name &synchronizer, const uint64_t height, const checksum256 &hash,
+                    const eosio::ignore<std::vector<chunk_data>> &chunks);
+
+    /**
+     * ## ACTION `verifymode`
+     *
+     * - **authority**: `synchronizer`
+     *
+     * > Enable or disable the merkle verification of blocks while they are being uploaded
+     *
+     * ### params
+     *
+     * - `{name} synchronizer` - synchronizer account
+     * - `{bool} verify_on_upload` - whether `pushchunk` verifies the merkle of the contiguous uploaded chunks
+     *
+     * ### example
+     *
+     * ```bash
+     * $ cleos push action blksync.xsat verifymode '["alice", true]' -p alice
+     * ```
+     */
+    [[eosio::action]]
+    void verifymode(const name &synchronizer, const bool verify_on_upload);
+
     /**
      * ## ACTION `delchunk`
      *
      * - **authority**: `synchronizer`
      *
-     * > Delete block shard data
+     * > Delete block shard data, chunks that have passed the verification on upload cannot be deleted
      *
      * ### params
      *
@@ -521,8 +979,8 @@ class [[eosio::contract("blksync.xsat")]] block_sync : public contract {
      *
      * - **authority**: `synchronizer`
      *
-     * > Verify block data
-
+     * > Verify block data, continuing from the transactions already verified on upload. A bucket whose chunks are shared with a bucket of the same block that already passed the
+     * merkle verification goes straight to `verify_parent_hash`, @see table `merklecache`
      *
      * ### params
      *
@@ -573,6 +1031,11 @@ class [[eosio::contract("blksync.xsat")]] block_sync : public contract {
         require_auth(get_self());
     }
 
+    [[eosio::action]]
+    void chunkslog(const uint64_t bucket_id, const std::vector<uint8_t> &chunk_ids, const uint8_t uploaded_num_chunks) {
+        require_auth(get_self());
+    }
+
     [[eosio::action]]
     void delchunklog(const uint64_t bucket_id, const uint8_t chunk_id, const uint8_t uploaded_num_chunks) {
         require_auth(get_self());
@@ -585,20 +1048,161 @@ class [[eosio::contract("blksync.xsat")]] block_sync : public contract {
 
     using consensus_action = eosio::action_wrapper<"consensus"_n, &block_sync::consensus>;
     using delchunks_action = eosio::action_wrapper<"delchunks"_n, &block_sync::delchunks>;
+    using erase_action = eosio::action_wrapper<"erase"_n, &block_sync::erase>;
     using bucketlog_action = eosio::action_wrapper<"bucketlog"_n, &block_sync::bucketlog>;
     using chunklog_action = eosio::action_wrapper<"chunklog"_n, &block_sync::chunklog>;
+    using chunkslog_action = eosio::action_wrapper<"chunkslog"_n, &block_sync::chunkslog>;
     using delchunklog_action = eosio::action_wrapper<"delchunklog"_n, &block_sync::delchunklog>;
     using delbucketlog_action = eosio::action_wrapper<"delbucketlog"_n, &block_sync::delbucketlog>;
 
+    // blocks of [blockheaders] that have not reached consensus, and then consensus blocks
+    static optional<bitcoin::core::block> get_header_ancestor(const uint64_t height, const optional<checksum256> hash);
+
+    static checksum256 compute_merkle_cache_key(const checksum256 &hash, const checksum256 &digest) {
+        std::array<uint8_t, 64> data;
+        eosio::datastream<uint8_t *> ds(data.data(), data.size());
+        ds << hash << digest;
+        return eosio::sha256((char *)data.data(), data.size());
+    }
+
     static uint64_t compute_passed_index_id(const uint64_t block_id, const uint64_t miner_priority,
                                             const uint64_t pass_number) {
         // block_id (32 bit) + miner priority (8 bit) + pass number (24)
         return block_id << 32 | miner_priority << 24 | pass_number;
     }
 
+    // iterator of the chunk data, in [chunk.data] or in [block.chunk] of the bucket for legacy chunks
+    inline static int32_t find_chunk_data(const eosio::name &code, const uint64_t bucket_id, const eosio::name &table,
+                                          const chunk_offset &chunk) {
+        if (chunk.data_id > 0) {
+            return eosio::internal_use_do_not_use::db_find_i64(code.value, code.value, CHUNK_DATA.value, chunk.data_id);
+        }
+        return eosio::internal_use_do_not_use::db_find_i64(code.value, bucket_id, table.value, chunk.chunk_id);
+    }
+
     // [start, end)
     inline static std::vector<char> read_bucket(const eosio::name &code, const uint64_t bucket_id,
                                                 const eosio::name &table, const uint64_t start, const uint64_t end) {
+        chunk_offset_table _chunk_offset(code, bucket_id);
+        if (!_chunk_offset.exists()) {
+            return scan_bucket(code, bucket_id, table, start, end);
+        }
+
+        const auto chunk_offsets = _chunk_offset.get();
+        const auto &chunks = chunk_offsets.chunks;
+        const auto last_position = std::min(end, chunk_offsets.total_size());
+
+        std::vector<char> result;
+        if (start >= last_position) {
+            return result;
+        }
+        result.resize(last_position - start);
+
+        // jump to the chunk that contains start
+        auto chunk_itr = std::upper_bound(chunks.begin(), chunks.end(), start,
+                                          [](const uint64_t position, const chunk_offset &chunk) {
+                                              return position < static_cast<uint64_t>(chunk.offset) + chunk.size;
+                                          });
+        size_t offset = 0;
+        while (offset < result.size()) {
+            auto iter = find_chunk_data(code, bucket_id, table, *chunk_itr);
+            check(iter >= 0, "blksync.xsat::read_bucket: chunk does not exists");
+            const uint64_t from = start > chunk_itr->offset ? start - chunk_itr->offset : 0;
+            const uint64_t to = std::min<uint64_t>(last_position - chunk_itr->offset, chunk_itr->size);
+            if (from == 0) {
+                eosio::internal_use_do_not_use::db_get_i64(iter, result.data() + offset, to);
+            } else {
+                // db_get_i64 always copies from the beginning of the row
+                std::vector<char> data;
+                data.resize(to);
+                eosio::internal_use_do_not_use::db_get_i64(iter, data.data(), to);
+                std::copy(data.begin() + from, data.end(), result.begin() + offset);
+            }
+            offset += to - from;
+            chunk_itr++;
+        }
+        return result;
+    }
+
+    // Reads a bucket from start, loading whole chunks into data only as the caller consumes them
+    struct bucket_reader {
+        eosio::name code;
+        uint64_t bucket_id;
+        eosio::name table;
+        // block position of data[0]
+        uint64_t start;
+        std::vector<char> data;
+        std::vector<chunk_offset> chunks;
+        size_t next_chunk = 0;
+        // only read chunk_ids 0, 1, 2, ... without gaps, for buckets that are still uploading
+        bool contiguous;
+
+        bucket_reader(const eosio::name &code, const uint64_t bucket_id, const eosio::name &table,
+                      const uint64_t start, const bool contiguous = false)
+            : code(code), bucket_id(bucket_id), table(table), start(start), contiguous(contiguous) {
+            chunk_offset_table _chunk_offset(code, bucket_id);
+            if (!_chunk_offset.exists()) {
+                if (!contiguous) {
+                    data = scan_bucket(code, bucket_id, table, start, std::numeric_limits<uint64_t>::max());
+                }
+                return;
+            }
+            chunks = _chunk_offset.get().chunks;
+            next_chunk = std::upper_bound(chunks.begin(), chunks.end(), start,
+                                          [](const uint64_t position, const chunk_offset &chunk) {
+                                              return position < static_cast<uint64_t>(chunk.offset) + chunk.size;
+                                          })
+                         - chunks.begin();
+        }
+
+        // append the next chunk, false if there is nothing left to read
+        bool load_next() {
+            if (next_chunk >= chunks.size() || (contiguous && chunks[next_chunk].chunk_id != next_chunk)) {
+                return false;
+            }
+            const auto &chunk = chunks[next_chunk++];
+            auto iter = find_chunk_data(code, bucket_id, table, chunk);
+            check(iter >= 0, "blksync.xsat::bucket_reader: chunk does not exists");
+
+            const uint64_t from = start > chunk.offset ? start - chunk.offset : 0;
+            const auto offset = data.size();
+            data.resize(offset + chunk.size - from);
+            if (from == 0) {
+                eosio::internal_use_do_not_use::db_get_i64(iter, data.data() + offset, chunk.size);
+            } else {
+                std::vector<char> buffer;
+                buffer.resize(chunk.size);
+                eosio::internal_use_do_not_use::db_get_i64(iter, buffer.data(), chunk.size);
+                std::copy(buffer.begin() + from, buffer.end(), data.begin() + offset);
+            }
+            return true;
+        }
+
+        // make sure [0, size) of data is loaded
+        bool load(const size_t size) {
+            while (data.size() < size) {
+                if (!load_next()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // make sure the whole transaction starting at position of data is loaded
+        bool load_transaction(const size_t position) {
+            while (position > data.size()
+                   || !bitcoin::core::transaction_size(data.data() + position, data.size() - position).has_value()) {
+                if (!load_next()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    // [start, end), walks all chunks of buckets that have no [chunkoffsets]
+    inline static std::vector<char> scan_bucket(const eosio::name &code, const uint64_t bucket_id,
+                                                const eosio::name &table, const uint64_t start, const uint64_t end) {
         // itr, size, from, to
         std::vector<std::tuple<int32_t, int32_t, int32_t, int32_t>> ranges;
         auto last_position = 0;
@@ -651,12 +1255,41 @@ class [[eosio::contract("blksync.xsat")]] block_sync : public contract {
 
     uint64_t next_bucket_id();
 
+    chunk_offset_row get_chunk_offsets(const uint64_t bucket_id, const std::set<uint16_t> &chunk_ids);
+
+    uint64_t next_chunk_data_id();
+
+    // chunk data in the action data, not copied
+    struct chunk_input {
+        uint8_t chunk_id;
+        const char *data;
+        uint32_t size;
+    };
+
+    void store_chunks(const name &synchronizer, const uint64_t height, const checksum256 &hash,
+                      const std::vector<chunk_input> &chunks, uint64_t &bucket_id, uint8_t &uploaded_num_chunks);
+
+    uint64_t acquire_chunk_data(const char *data, const uint32_t size);
+
+    void release_chunk_data(const uint64_t bucket_id, const chunk_offset &chunk);
+
+    void erase_bucket_chunks(const uint64_t bucket_id);
+
+    std::optional<checksum256> compute_bucket_digest(const uint64_t bucket_id);
+
     void find_miner(std::vector<bitcoin::core::transaction_output> outputs, name &miner, vector<string> &btc_miners);
 
-    optional<string> check_transaction(const bitcoin::core::transaction tx);
+    optional<string> check_transaction(const bitcoin::core::transaction_view &tx);
 
+    // partial: verify the complete transactions of the contiguous uploaded chunks, stop instead of failing when
+    // block data is missing
     template <typename ITR>
-    optional<string> check_merkle(const ITR &block_bucket_itr, verify_info_data &verify_info);
+    optional<string> check_merkle(const ITR &block_bucket_itr, verify_info_data &verify_info,
+                                  const bool partial = false);
+
+    bitcoin::merkle_frontier restore_merkle_frontier(const std::vector<checksum256> &roots, const uint64_t count);
+
+    void save_merkle_frontier(const bitcoin::merkle_frontier &frontier, std::vector<checksum256> &roots);
 
     template <typename T, typename ITR>
     verify_block_result check_fail(T &_block_bucket, const ITR block_bucket_itr, const string &state,
@@ -21,14 +21,7 @@ void block_sync::cleartable(const name table_name, const name &synchronizer, con
     else if (table_name == "blockbuckets"_n)
         clear_table(_block_bucket, rows_to_clear);
     else if (table_name == "block.chunk"_n) {
-        auto iter
-            = eosio::internal_use_do_not_use::db_lowerbound_i64(get_self().value, bucket_id, BLOCK_CHUNK.value, 0);
-        while (iter >= 0) {
-            uint64_t ignored;
-            auto next_iter = eosio::internal_use_do_not_use::db_next_i64(iter, &ignored);
-            eosio::internal_use_do_not_use::db_remove_i64(iter);
-            iter = next_iter;
-        }
+        erase_bucket_chunks(bucket_id);
     } else if (table_name == "passedindexs"_n)
         clear_table(_pass_index, rows_to_clear);
     else if (table_name == "blockminer"_n)
@@ -90,6 +83,8 @@ void block_sync::forkblock(const name &synchronizer, const uint64_t height, cons
 
     auto script = xsat::utils::encode_op_return_eos_account(account);
     transactions[0].outputs[0].script.data = script;
+    // the raw bytes no longer match, hash the re-serialized transaction
+    transactions[0].data = nullptr;
 
     bool mutated;
     block_header.merkle = bitcoin::core::generate_header_merkle(transactions, &mutated);
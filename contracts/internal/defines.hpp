@@ -71,6 +71,7 @@ static constexpr name TRIGGER_ACCOUNT = "trigger.xsat"_n;
 
 // TABLE
 static constexpr name BLOCK_CHUNK = "block.chunk"_n;
+static constexpr name CHUNK_DATA = "chunk.data"_n;
 
 // SYMBOLS
 static constexpr symbol XSAT_SYMBOL = {"XSAT", 8};
@@ -89,11 +90,23 @@ static constexpr uint64_t MIN_XSAT_STAKE_FOR_VALIDATOR = 21000LL * DECIMAL;
 static constexpr uint64_t XSAT_SUPPLY = 21000000LL * DECIMAL;
 
 static constexpr uint64_t IRREVERSIBLE_BLOCKS = 6;
+// how far parsing may run ahead of the migrating block before its parser is asked to migrate
+static constexpr uint64_t MAX_PARSE_LEAD_BLOCKS = 2 * IRREVERSIBLE_BLOCKS;
 static constexpr uint64_t SUBSIDY_HALVING_INTERVAL = 210000;
 
 static constexpr uint64_t BLOCK_HEADER_SIZE = 80;
 static constexpr uint64_t MAX_BLOCK_SIZE = 4LL * 1024 * 1024;
 static constexpr uint8_t MAX_NUM_CHUNKS = 64;
+// two difficulty adjustment intervals, covers the retarget anchor of the current and previous period
+static constexpr uint64_t HEADER_RING_SIZE = 4032;
+// number of pending utxos packed into one `pendingpages` row
+static constexpr uint32_t PENDING_PAGE_SIZE = 256;
+
+// cost units of the verify and processblock budgets
+static constexpr uint64_t WEIGHT_PER_HASHED_BYTE = 1;
+static constexpr uint64_t WEIGHT_PER_INPUT = 200;
+static constexpr uint64_t WEIGHT_PER_OUTPUT = 100;
+static constexpr uint64_t WEIGHT_PER_UTXO_ROW = 2000;
 
 static constexpr uint64_t DEFAULT_PRODUCTED_BLOCK_LIMIT = 432;
 static constexpr uint64_t DEFAULT_NUM_SLOTS = 2;
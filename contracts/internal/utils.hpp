@@ -122,6 +122,10 @@ namespace xsat::utils {
         return (script[0] == 0x00 && script[1] == 0x6a) || script[0] == 0x6a;
     }
 
+    static bool is_unspendable_legacy(const uint8_t* script, const size_t size) {
+        return size > 0 && ((size > 1 && script[0] == 0x00 && script[1] == 0x6a) || script[0] == 0x6a);
+    }
+
     // OP_FALSE OP_RETURN
     static bool is_unspendable_genesis(const vector<uint8_t>& script) { return script[0] == 0x00 && script[1] == 0x6a; }
 
@@ -18,12 +18,27 @@ void utxo_manage::cleartable(const name table_name, const optional<uint64_t> sco
         clear_table(_pending_utxo, rows_to_clear);
     else if (table_name == "spentutxos"_n)
         clear_table(_spent_utxo, rows_to_clear);
+    else if (table_name == "balances"_n)
+        clear_table(_balance, rows_to_clear);
+    else if (table_name == "pendingpages"_n) {
+        pending_page_table _pending_page(get_self(), value);
+        clear_table(_pending_page, rows_to_clear);
+    } else if (table_name == "pendingindex"_n) {
+        pending_index_table _pending_index(get_self(), value);
+        clear_table(_pending_index, rows_to_clear);
+    }
     else if (table_name == "blocks"_n)
         clear_table(_block, rows_to_clear);
     else if (table_name == "block.extra"_n)
         clear_table(_block_extra, rows_to_clear);
     else if (table_name == "consensusblk"_n)
         clear_table(_consensus_block, rows_to_clear);
+    else if (table_name == "parsingprogs"_n)
+        clear_table(_block_parsing, rows_to_clear);
+    else if (table_name == "headerring"_n)
+        clear_table(_header_ring, rows_to_clear);
+    else if (table_name == "branches"_n)
+        clear_table(_branch, rows_to_clear);
     else if (table_name == "chainstate"_n)
         _chain_state.remove();
     else if (table_name == "config"_n)
@@ -85,16 +100,28 @@ void utxo_manage::resetpending(uint64_t row) {
         auto chain_state = _chain_state.get();
         auto config = _config.get();
         auto consensus_block_idx = _consensus_block.get_index<"byheight"_n>();
+
+        // pending utxos of the blocks that have not been migrated
+        auto pending_block_itr = consensus_block_idx.lower_bound(chain_state.irreversible_height + 1);
+        for (; pending_block_itr != consensus_block_idx.end(); pending_block_itr++) {
+            if (erase_pending_utxos(pending_block_itr->bucket_id, row)) {
+                return;
+            }
+        }
+
         auto consensus_block_itr = consensus_block_idx.lower_bound(chain_state.irreversible_height + 1);
         auto consensus_end = consensus_block_idx.upper_bound(chain_state.irreversible_height + 1);
 
         chain_state.parsed_height = chain_state.irreversible_height;
         chain_state.parsing_height = chain_state.irreversible_height + 1;
+        chain_state.parsing_progress_of.clear();
+        clear_table(_block_parsing, -1);
         while (consensus_block_itr != consensus_end) {
-            chain_state.parsing_progress_of[consensus_block_itr->hash]
-                = {.bucket_id = consensus_block_itr->bucket_id,
-                   .parser = consensus_block_itr->synchronizer,
-                   .parse_expiration_time = current_time_point() + eosio::seconds(config.parse_timeout_seconds)};
+            set_parsing_progress(
+                consensus_block_itr->hash,
+                {.bucket_id = consensus_block_itr->bucket_id,
+                 .parser = consensus_block_itr->synchronizer,
+                 .parse_expiration_time = current_time_point() + eosio::seconds(config.parse_timeout_seconds)});
             consensus_block_itr++;
         }
         chain_state.status = waiting;
@@ -135,6 +162,14 @@ void utxo_manage::addtestblock(const uint64_t height, const checksum256& hash, c
             row.nonce = nonce;
         });
     }
+
+    save_header({.height = height,
+                 .hash = hash,
+                 .previous_block_hash = previous_block_hash,
+                 .cumulative_work = cumulative_work,
+                 .timestamp = timestamp,
+                 .bits = bits},
+                true);
 }
 
 [[eosio::action]]
@@ -179,4 +214,40 @@ void utxo_manage::addconsesblk(const uint64_t bucket_id, const uint64_t height,
             row.created_at = created_at;
         });
     }
-}
\ No newline at end of file
+}
+
+[[eosio::action]]
+void utxo_manage::addspentutxo(const uint64_t id, const uint64_t height, const checksum256& txid, const uint32_t index,
+                               const vector<uint8_t>& scriptpubkey, const uint64_t value) {
+    require_auth(get_self());
+
+    _spent_utxo.emplace(get_self(), [&](auto& row) {
+        row.id = id;
+        row.height = height;
+        row.txid = txid;
+        row.index = index;
+        row.scriptpubkey = scriptpubkey;
+        row.value = value;
+    });
+}
+
+[[eosio::action]]
+void utxo_manage::addlegacyutxo(const uint64_t id, const checksum256& txid, const uint32_t index,
+                                const vector<uint8_t>& scriptpubkey, const uint64_t value) {
+    require_auth(get_self());
+
+    // a row as saved before script compression, balances and the `byscriptid` index, the chain state is left
+    // untouched
+    eosio::multi_index<
+        "utxos"_n, utxo_row,
+        eosio::indexed_by<"scriptpubkey"_n, const_mem_fun<utxo_row, checksum256, &utxo_row::by_scriptpubkey>>,
+        eosio::indexed_by<"byutxoid"_n, const_mem_fun<utxo_row, checksum256, &utxo_row::by_utxo_id>>>
+        _legacy_utxo(get_self(), get_self().value);
+    _legacy_utxo.emplace(get_self(), [&](auto& row) {
+        row.id = id;
+        row.txid = txid;
+        row.index = index;
+        row.scriptpubkey = scriptpubkey;
+        row.value = value;
+    });
+}
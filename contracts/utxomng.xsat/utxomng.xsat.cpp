@@ -55,6 +55,27 @@ void utxo_manage::config(const uint16_t parse_timeout_seconds, const uint16_t nu
     _config.set(config, get_self());
 }
 
+//@auth get_self()
+[[eosio::action]]
+void utxo_manage::setbudget(const uint64_t verification_budget, const uint64_t parse_budget) {
+    require_auth(get_self());
+
+    auto config = _config.get_or_default();
+    config.verification_budget = verification_budget;
+    config.parse_budget = parse_budget;
+    _config.set(config, get_self());
+}
+
+//@auth get_self()
+[[eosio::action]]
+void utxo_manage::setindexing(const bool index_pending_utxos) {
+    require_auth(get_self());
+
+    auto config = _config.get_or_default();
+    config.index_pending_utxos = index_pending_utxos;
+    _config.set(config, get_self());
+}
+
 //@auth get_self()
 [[eosio::action]]
 void utxo_manage::addutxo(const uint64_t id, const checksum256& txid, const uint32_t index,
@@ -63,25 +84,36 @@ void utxo_manage::addutxo(const uint64_t id, const checksum256& txid, const uint
 
     auto chain_state = _chain_state.get_or_default();
     check(chain_state.head_height <= START_HEIGHT, "utxomng.xsat::addutxo: height must be less than or equal to 839999");
+    upgrade_chain_state(chain_state);
 
-    auto utxo_idx = _utxo.get_index<"byutxoid"_n>();
-    auto utxo_itr = utxo_idx.find(xsat::utils::compute_utxo_id(txid, index));
-    if (utxo_itr == utxo_idx.end()) {
-        _utxo.emplace(get_self(), [&](auto& row) {
+    std::vector<uint8_t> script_data;
+    const auto script_type = bitcoin::compress_script(scriptpubkey, script_data);
+
+    auto utxo_itr = find_utxo(txid, index);
+    if (utxo_itr == _utxo.end()) {
+        utxo_itr = _utxo.emplace(get_self(), [&](auto& row) {
             row.id = id;
             row.txid = txid;
             row.index = index;
-            row.scriptpubkey = scriptpubkey;
+            row.scriptpubkey = script_data;
             row.value = value;
+            row.script_type = script_type;
+            row.counted = true;
         });
         chain_state.num_utxos += 1;
-        _chain_state.set(chain_state, get_self());
     } else {
-        utxo_idx.modify(utxo_itr, same_payer, [&](auto& row) {
-            row.scriptpubkey = scriptpubkey;
+        update_utxo_set_hash(chain_state, *utxo_itr, true);
+        update_balance(chain_state, *utxo_itr, true);
+        _utxo.modify(utxo_itr, same_payer, [&](auto& row) {
+            row.scriptpubkey = script_data;
             row.value = value;
+            row.script_type = script_type;
+            row.counted = true;
         });
     }
+    update_utxo_set_hash(chain_state, *utxo_itr, false);
+    update_balance(chain_state, *utxo_itr, false);
+    _chain_state.set(chain_state, get_self());
 }
 
 //@auth get_self()
@@ -91,14 +123,140 @@ void utxo_manage::delutxo(const uint64_t id) {
 
     auto chain_state = _chain_state.get_or_default();
     check(chain_state.head_height <= START_HEIGHT, "utxomng.xsat::delutxo: height must be less than or equal to 839999");
+    upgrade_chain_state(chain_state);
 
     auto& utxo = _utxo.get(id, "utxomng.xsat::delutxo: [utxos] does not exist");
+    update_utxo_set_hash(chain_state, utxo, true);
+    update_balance(chain_state, utxo, true);
     _utxo.erase(utxo);
 
     chain_state.num_utxos -= 1;
     _chain_state.set(chain_state, get_self());
 }
 
+//@auth get_self()
+[[eosio::action]]
+optional<uint64_t> utxo_manage::countutxos(const uint64_t from_id, const uint16_t limit) {
+    require_auth(get_self());
+    check(limit > 0, "utxomng.xsat::countutxos: limit must be greater than 0");
+
+    auto chain_state = _chain_state.get_or_default();
+    upgrade_chain_state(chain_state);
+
+    auto utxo_itr = _utxo.lower_bound(from_id);
+    for (uint16_t i = 0; utxo_itr != _utxo.end() && i < limit; i++) {
+        if (utxo_itr->counted.value_or(false)) {
+            utxo_itr++;
+            continue;
+        }
+        // legacy rows keep their raw scriptpubkey, they are saved again because modify does not add the row to the
+        // `byscriptid` index created after it
+        auto utxo = *utxo_itr;
+        utxo.script_type = utxo.script_type.value_or(0);
+        utxo.counted = true;
+        utxo_itr = _utxo.erase(utxo_itr);
+        _utxo.emplace(get_self(), [&](auto& row) {
+            row = utxo;
+        });
+        update_utxo_set_hash(chain_state, utxo, false);
+        update_balance(chain_state, utxo, false);
+    }
+    _chain_state.set(chain_state, get_self());
+
+    if (utxo_itr != _utxo.end()) {
+        return utxo_itr->id;
+    }
+    return nullopt;
+}
+
+//@auth get_self()
+[[eosio::action]]
+void utxo_manage::importutxos(const uint64_t height, const std::vector<snapshot_utxo>& utxos,
+                              const optional<checksum256>& utxo_set_hash) {
+    require_auth(get_self());
+
+    auto chain_state = _chain_state.get_or_default();
+    check(chain_state.head_height <= START_HEIGHT,
+          "utxomng.xsat::importutxos: height must be less than or equal to 839999");
+    check(height == START_HEIGHT, "utxomng.xsat::importutxos: snapshot height must be 839999");
+    upgrade_chain_state(chain_state);
+
+    for (const auto& utxo : utxos) {
+        check(utxo.script_type <= bitcoin::SCRIPT_P2TR, "utxomng.xsat::importutxos: [script_type] unknown script template");
+        check(bitcoin::is_script_payload(utxo.script_type, utxo.scriptpubkey),
+              "utxomng.xsat::importutxos: [scriptpubkey] does not match the script template");
+        check(find_utxo(utxo.txid, utxo.index) == _utxo.end(), "utxomng.xsat::importutxos: [utxos] already exists");
+        save_utxo(chain_state, utxo.txid, utxo.index, utxo.script_type, utxo.scriptpubkey, utxo.value);
+    }
+    chain_state.num_utxos += utxos.size();
+
+    if (utxo_set_hash.has_value()) {
+        check(chain_state.utxo_set_hash.value() == *utxo_set_hash,
+              "utxomng.xsat::importutxos: utxo set hash mismatch");
+    }
+    _chain_state.set(chain_state, get_self());
+}
+
+[[eosio::action, eosio::read_only]]
+utxo_manage::export_utxos_result utxo_manage::exportutxos(const uint64_t from_id, const uint16_t limit) {
+    check(limit > 0, "utxomng.xsat::exportutxos: limit must be greater than 0");
+
+    const auto chain_state = _chain_state.get_or_default();
+    export_utxos_result result = {.height = chain_state.irreversible_height,
+                                  .utxo_set_hash = chain_state.utxo_set_hash.value_or(checksum256())};
+    auto utxo_itr = _utxo.lower_bound(from_id);
+    for (; utxo_itr != _utxo.end() && result.utxos.size() < limit; utxo_itr++) {
+        result.utxos.push_back({.txid = utxo_itr->txid,
+                                .index = utxo_itr->index,
+                                .script_type = utxo_itr->script_type.value_or(0),
+                                .scriptpubkey = utxo_itr->scriptpubkey,
+                                .value = utxo_itr->value});
+    }
+    if (utxo_itr != _utxo.end()) {
+        result.next_id = utxo_itr->id;
+    }
+    return result;
+}
+
+[[eosio::action, eosio::read_only]]
+optional<utxo_manage::snapshot_utxo> utxo_manage::getutxo(const checksum256& txid, const uint32_t index) {
+    auto utxo_itr = find_utxo(txid, index);
+    if (utxo_itr == _utxo.end()) {
+        return nullopt;
+    }
+    return snapshot_utxo{.txid = utxo_itr->txid,
+                         .index = utxo_itr->index,
+                         .script_type = utxo_itr->script_type.value_or(0),
+                         .scriptpubkey = utxo_itr->scriptpubkey,
+                         .value = utxo_itr->value};
+}
+
+[[eosio::action, eosio::read_only]]
+utxo_manage::get_utxos_result utxo_manage::getutxos(const vector<uint8_t>& scriptpubkey, const uint64_t cursor,
+                                                    const uint16_t limit) {
+    check(limit > 0, "utxomng.xsat::getutxos: limit must be greater than 0");
+
+    // the key carries the id after the scriptpubkey hash, the page is sought at the cursor whether or not its utxo
+    // still exists
+    const auto scripthash = xsat::utils::hash(scriptpubkey);
+    auto utxo_idx = _utxo.get_index<"byscriptid"_n>();
+    auto utxo_itr = utxo_idx.lower_bound(compute_script_id(scripthash, cursor));
+    const auto utxo_end = utxo_idx.upper_bound(compute_script_id(scripthash, -1));
+
+    get_utxos_result result;
+    for (; utxo_itr != utxo_end; utxo_itr++) {
+        // scriptpubkeys that share the hash prefix of the key
+        if (utxo_itr->by_scriptpubkey() != scripthash)
+            continue;
+        if (result.utxos.size() == limit) {
+            result.cursor = utxo_itr->id;
+            break;
+        }
+        result.utxos.push_back({.txid = utxo_itr->txid, .index = utxo_itr->index, .value = utxo_itr->value});
+    }
+    return result;
+}
+
 //@auth get_self()
 [[eosio::action]]
 void utxo_manage::addblock(const uint64_t height, const checksum256& hash, const checksum256& cumulative_work,
@@ -133,6 +291,14 @@ void utxo_manage::addblock(const uint64_t height, const checksum256& hash, const
             row.nonce = nonce;
         });
     }
+
+    save_header({.height = height,
+                 .hash = hash,
+                 .previous_block_hash = previous_block_hash,
+                 .cumulative_work = cumulative_work,
+                 .timestamp = timestamp,
+                 .bits = bits},
+                true);
 }
 
 //@auth get_self()
@@ -142,6 +308,12 @@ void utxo_manage::delblock(const uint64_t height) {
     check(height <= START_HEIGHT, "utxomng.xsat::delblock: height must be less than or equal to 839999");
 
     auto block_itr = _block.require_find(height, "utxomng.xsat::delblock: [blocks] does not exist");
+
+    auto header_ring_itr = _header_ring.find(height % HEADER_RING_SIZE);
+    if (header_ring_itr != _header_ring.end() && header_ring_itr->height == height
+        && header_ring_itr->hash == block_itr->hash) {
+        _header_ring.erase(header_ring_itr);
+    }
     _block.erase(block_itr);
 }
 
@@ -236,12 +408,15 @@ void utxo_manage::consensus(const uint64_t height, const checksum256& hash) {
     eosio::datastream<const char*> block_stream(block_data.data(), block_data.size());
     bitcoin::core::block_header block_header;
     block_stream >> block_header;
+    const auto previous_block_hash = bitcoin::be_checksum256_from_uint(block_header.previous_block_hash);
 
+    const auto branch_id = save_branch(passed_index_itr->bucket_id, height, hash, previous_block_hash,
+                                       passed_index_itr->cumulative_work);
     _consensus_block.emplace(get_self(), [&](auto& row) {
         row.height = height;
         row.hash = hash;
         row.version = block_header.version;
-        row.previous_block_hash = bitcoin::be_checksum256_from_uint(block_header.previous_block_hash);
+        row.previous_block_hash = previous_block_hash;
         row.merkle = bitcoin::be_checksum256_from_uint(block_header.merkle);
         row.timestamp = block_header.timestamp;
         row.bits = block_header.bits;
@@ -251,9 +426,21 @@ void utxo_manage::consensus(const uint64_t height, const checksum256& hash) {
         row.miner = passed_index_itr->miner;
         row.synchronizer = passed_index_itr->synchronizer;
         row.created_at = current_time_point();
+        row.branch_id = branch_id;
     });
 
+    // forks of the same height keep the first consensus block until it becomes irreversible
+    save_header({.height = height,
+                 .hash = hash,
+                 .previous_block_hash = previous_block_hash,
+                 .cumulative_work = passed_index_itr->cumulative_work,
+                 .timestamp = block_header.timestamp,
+                 .bits = block_header.bits},
+                false);
+
     auto chain_state = _chain_state.get_or_default();
+    upgrade_chain_state(chain_state);
+
     // Set latest block height
     if (chain_state.head_height < height) {
         chain_state.head_height = height;
@@ -263,10 +450,11 @@ void utxo_manage::consensus(const uint64_t height, const checksum256& hash) {
     auto config = _config.get();
     if (chain_state.parsing_height == height) {
         chain_state.parsing_height = height;
-        chain_state.parsing_progress_of[hash]
-            = {.bucket_id = passed_index_itr->bucket_id,
-               .parser = passed_index_itr->synchronizer,
-               .parse_expiration_time = current_time_point() + eosio::seconds(config.parse_timeout_seconds)};
+        set_parsing_progress(hash,
+                             {.bucket_id = passed_index_itr->bucket_id,
+                              .parser = passed_index_itr->synchronizer,
+                              .parse_expiration_time
+                              = current_time_point() + eosio::seconds(config.parse_timeout_seconds)});
     } else {
         find_set_next_parsable_block(chain_state, config.parse_timeout_seconds);
     }
@@ -288,52 +476,117 @@ utxo_manage::process_block_result utxo_manage::processblock(const name& synchron
     require_auth(synchronizer);
 
     auto chain_state = _chain_state.get();
-    auto height = chain_state.parsing_height;
-    check(height > 0, "4001:utxomng.xsat::processblock: there are currently no block to parse");
+    check(chain_state.parsing_height > 0 || chain_state.migrating_height > 0,
+          "4001:utxomng.xsat::processblock: there are currently no block to parse");
+    upgrade_chain_state(chain_state);
 
     // Find parsable hash
     auto current_time = current_time_point();
-    checksum256 hash;
-    for (const auto& it : chain_state.parsing_progress_of) {
-        if (it.second.parser == synchronizer || it.second.parse_expiration_time <= current_time) {
-            hash = it.first;
+    auto block_parsing_itr = _block_parsing.end();
+    for (auto itr = _block_parsing.begin(); itr != _block_parsing.end(); itr++) {
+        if (itr->progress.parser == synchronizer || itr->progress.parse_expiration_time <= current_time) {
+            block_parsing_itr = itr;
         }
     }
 
-    check(hash != ZERO_HASH, "4003:utxomng.xsat::processblock: you are not a parser of the current block");
+    // other synchronizers help parsing the ranges of a split block
+    bool parse_range_only = false;
+    if (block_parsing_itr == _block_parsing.end()) {
+        for (auto itr = _block_parsing.begin(); itr != _block_parsing.end(); itr++) {
+            parse_range_table _parse_range(get_self(), itr->bucket_id);
+            if (find_parse_range(_parse_range, synchronizer, current_time) != _parse_range.end()) {
+                block_parsing_itr = itr;
+                parse_range_only = true;
+            }
+        }
+    }
+    const auto hash = block_parsing_itr != _block_parsing.end() ? block_parsing_itr->hash : ZERO_HASH;
+
+    // the parser of a split block has nothing to parse while its remaining ranges are held by other synchronizers
+    bool ranges_held = false;
+    if (block_parsing_itr != _block_parsing.end() && !parse_range_only) {
+        parse_range_table _parse_range(get_self(), block_parsing_itr->bucket_id);
+        ranges_held = _parse_range.begin() != _parse_range.end()
+                      && find_parse_range(_parse_range, synchronizer, current_time) == _parse_range.end();
+    }
 
-    // fee deduction
-    resource_management::pay_action pay(RESOURCE_MANAGE_CONTRACT, {get_self(), "active"_n});
-    pay.send(height, hash, synchronizer, PARSE, 1);
+    // Parsing and migration are independent lanes, synchronizers that have nothing to parse migrate the irreversible
+    // block, and the parser falls back to migration when parsing runs too far ahead of it
+    const bool migrate_only
+        = chain_state.migrating_height > 0
+          && (hash == ZERO_HASH || ranges_held
+              || chain_state.parsing_height > chain_state.migrating_height + MAX_PARSE_LEAD_BLOCKS);
+    check(migrate_only || hash != ZERO_HASH,
+          "4003:utxomng.xsat::processblock: you are not a parser of the current block");
 
     auto config = _config.get();
-    auto& parsing_progress = chain_state.parsing_progress_of[hash];
-
-    // verify permissions and whether parsing times out
-    if (parsing_progress.parse_expiration_time > current_time) {
-        check(synchronizer == parsing_progress.parser,
-              "4004:utxomng.xsat::processblock: you are not a parser of the current block");
-    } else {
+    resource_management::pay_action pay(RESOURCE_MANAGE_CONTRACT, {get_self(), "active"_n});
+    process_block_result result;
+    if (migrate_only) {
         pool::synchronizer_table _synchronizer(POOL_REGISTER_CONTRACT, POOL_REGISTER_CONTRACT.value);
         _synchronizer.require_find(synchronizer.value, "4005:utxomng.xsat::processblock: only synchronizers can parse");
 
-        parsing_progress.parser = synchronizer;
-        parsing_progress.parse_expiration_time = current_time + eosio::seconds(config.parse_timeout_seconds);
-    }
+        // fee deduction
+        pay.send(chain_state.migrating_height, chain_state.migrating_hash, synchronizer, PARSE, 1);
 
-    // Migrate irreversible block data first and then parse the latest block
-    if (chain_state.status == waiting) {
-        if (chain_state.migrating_height > 0) {
-            chain_state.status = migrating;
+        result = {.height = chain_state.migrating_height, .block_hash = chain_state.migrating_hash};
+        process_migration(chain_state, config, process_row);
+        result.status = get_parsing_status_name(chain_state.status);
+    } else if (ranges_held) {
+        // wait until a range is parsed or its parse times out
+        result = {.status = "waiting_ranges", .height = chain_state.parsing_height, .block_hash = hash};
+    } else {
+        auto height = chain_state.parsing_height;
+
+        // fee deduction
+        pay.send(height, hash, synchronizer, PARSE, 1);
 
-            // issue reward
-            reward_distribution::distribute_action _distribute(REWARD_DISTRIBUTION_CONTRACT, {get_self(), "active"_n});
-            _distribute.send(chain_state.migrating_height);
+        auto parsing_progress = block_parsing_itr->progress;
+
+        // verify permissions and whether parsing times out
+        if (parse_range_only) {
+            pool::synchronizer_table _synchronizer(POOL_REGISTER_CONTRACT, POOL_REGISTER_CONTRACT.value);
+            _synchronizer.require_find(synchronizer.value,
+                                       "4005:utxomng.xsat::processblock: only synchronizers can parse");
+        } else if (parsing_progress.parse_expiration_time > current_time) {
+            check(synchronizer == parsing_progress.parser,
+                  "4004:utxomng.xsat::processblock: you are not a parser of the current block");
         } else {
-            chain_state.status = parsing;
+            pool::synchronizer_table _synchronizer(POOL_REGISTER_CONTRACT, POOL_REGISTER_CONTRACT.value);
+            _synchronizer.require_find(synchronizer.value,
+                                       "4005:utxomng.xsat::processblock: only synchronizers can parse");
+
+            parsing_progress.parser = synchronizer;
+            parsing_progress.parse_expiration_time = current_time + eosio::seconds(config.parse_timeout_seconds);
+        }
+
+        result = {.status = get_parsing_status_name(parsing), .height = height, .block_hash = hash};
+        if (process_parsing(chain_state, block_parsing_itr, parsing_progress, synchronizer, process_row, config)) {
+            result.status = "parsing_completed";
         }
     }
 
+    // The status follows the migration lane while it holds a block, otherwise whether a block is being parsed
+    if (chain_state.migrating_height == 0) {
+        chain_state.status = chain_state.parsing_height > 0 ? parsing : waiting;
+    } else if (chain_state.status == parsing) {
+        chain_state.status = waiting;
+    }
+
+    // save state
+    _chain_state.set(chain_state, get_self());
+    return result;
+}
+
+void utxo_manage::process_migration(chain_state_row& chain_state, const config_row& config, uint64_t process_row) {
+    if (chain_state.status == waiting || chain_state.status == parsing) {
+        chain_state.status = migrating;
+
+        // issue reward
+        reward_distribution::distribute_action _distribute(REWARD_DISTRIBUTION_CONTRACT, {get_self(), "active"_n});
+        _distribute.send(chain_state.migrating_height);
+    }
+
     if (chain_state.status == migrating) {
         migrate(chain_state, process_row);
 
@@ -367,104 +620,265 @@ utxo_manage::process_block_result utxo_manage::processblock(const name& synchron
             chain_state.synchronizer = {};
             chain_state.miner = {};
             chain_state.parser = {};
-            chain_state.status = parsing;
-        }
-    } else if (chain_state.status == parsing) {
-        parsing_transactions(height, hash, &parsing_progress, process_row);
-
-        if (parsing_progress.num_transactions == parsing_progress.parsed_transactions) {
-            auto consensus_block_itr = _consensus_block.require_find(parsing_progress.bucket_id);
-            _consensus_block.modify(consensus_block_itr, same_payer, [&](auto& row) {
-                row.parse = true;
-                row.parser = synchronizer;
-                row.num_utxos = parsing_progress.num_utxos;
-            });
+            chain_state.status = waiting;
 
-            chain_state.parsing_progress_of.erase(hash);
+            // the parsed blocks may already allow the next block to be migrated
+            find_set_next_irreversible_block(chain_state);
         }
+    }
+}
 
-        // If all are parsed, set the next parsed block
-        if (chain_state.parsing_progress_of.empty()) {
-            chain_state.status = waiting;
-            chain_state.parsed_height = height;
-            chain_state.parsing_height = 0;
+bool utxo_manage::process_parsing(chain_state_row& chain_state, block_parsing_table::const_iterator block_parsing_itr,
+                                  parsing_progress_row& parsing_progress, const name& synchronizer,
+                                  uint64_t process_row, const config_row& config) {
+    auto height = chain_state.parsing_height;
+    const auto hash = block_parsing_itr->hash;
 
-            // Set the latest parsable block height
-            find_set_next_parsable_block(chain_state, config.parse_timeout_seconds);
+    parse_range_table _parse_range(get_self(), parsing_progress.bucket_id);
+    if (parsing_progress.parsed_position == 0 && _parse_range.begin() == _parse_range.end()) {
+        init_parse_ranges(parsing_progress);
+    }
 
-            // Set the block height of the latest migration
-            find_set_next_irreversible_block(chain_state);
-        }
+    if (_parse_range.begin() != _parse_range.end()) {
+        parse_range(height, hash, synchronizer, &parsing_progress, process_row, config);
+    } else {
+        parsing_transactions(height, hash, 0, &parsing_progress, process_row, config.parse_budget.value_or(0),
+                             config.index_pending_utxos.value_or(false));
     }
 
-    // save state
-    _chain_state.set(chain_state, get_self());
+    const bool completed = parsing_progress.num_transactions > 0
+                           && parsing_progress.num_transactions == parsing_progress.parsed_transactions;
+    if (parsing_progress.num_transactions == parsing_progress.parsed_transactions) {
+        auto consensus_block_itr = _consensus_block.require_find(parsing_progress.bucket_id);
+        _consensus_block.modify(consensus_block_itr, same_payer, [&](auto& row) {
+            row.parse = true;
+            row.parser = synchronizer;
+            row.num_utxos = parsing_progress.num_utxos;
+        });
 
-    auto status = get_parsing_status_name(chain_state.status);
-    if (parsing_progress.num_transactions > 0
-        && parsing_progress.num_transactions == parsing_progress.parsed_transactions) {
-        status = "parsing_completed";
+        _block_parsing.erase(block_parsing_itr);
+    } else {
+        _block_parsing.modify(block_parsing_itr, same_payer, [&](auto& row) {
+            row.progress = parsing_progress;
+        });
+    }
+
+    // If all are parsed, set the next parsed block
+    if (_block_parsing.begin() == _block_parsing.end()) {
+        chain_state.parsed_height = height;
+        chain_state.parsing_height = 0;
+
+        // Set the latest parsable block height
+        find_set_next_parsable_block(chain_state, config.parse_timeout_seconds);
+
+        // Set the block height of the latest migration
+        find_set_next_irreversible_block(chain_state);
     }
-    return {.status = status, .height = height, .block_hash = hash};
+    return completed;
 }
 
-void utxo_manage::parsing_transactions(const uint64_t height, const checksum256& hash,
-                                       parsing_progress_row* parsing_progress, uint64_t process_row) {
-    auto block_data = block_sync::read_bucket(BLOCK_SYNC_CONTRACT, parsing_progress->bucket_id, BLOCK_CHUNK,
-                                              BLOCK_HEADER_SIZE + parsing_progress->parsed_position,
-                                              std::numeric_limits<uint64_t>::max());
-    eosio::datastream<const char*> block_stream(block_data.data(), block_data.size());
+void utxo_manage::parsing_transactions(const uint64_t height, const checksum256& hash, const uint64_t range,
+                                       parsing_progress_row* parsing_progress, uint64_t process_row,
+                                       const uint64_t budget, const bool index_pending_utxos) {
+    block_sync::bucket_reader reader(BLOCK_SYNC_CONTRACT, parsing_progress->bucket_id, BLOCK_CHUNK,
+                                     BLOCK_HEADER_SIZE + parsing_progress->parsed_position);
+    size_t position = 0;
 
     // init num_transactions
     if (parsing_progress->parsed_position == 0) {
+        // num_transactions varint (at most 9 bytes)
+        reader.load(9);
+        eosio::datastream<const char*> block_stream(reader.data.data(), reader.data.size());
         parsing_progress->num_transactions = bitcoin::varint::decode(block_stream);
+        position = block_stream.tellp();
     }
 
     if (process_row == 0)
         process_row = -1;
 
+    // weight of the processed rows, at least one row is processed regardless of the budget
+    uint64_t weight = 0;
+    uint64_t processed_rows = 0;
+    const auto within_budget = [&](const uint64_t next_weight) {
+        return budget == 0 || processed_rows == 0 || weight + next_weight <= budget;
+    };
+
     uint64_t parsed_position = 0;
-    std::vector<uint8_t> script_data = {};
+    std::vector<char> txid_buffer;
+
+    // utxos of this round, appended to pendingpages at the end
+    std::vector<pending_utxo> pending_utxos;
+    // vouts of this round that can still be netted, position in pending_utxos by outpoint
+    std::map<std::pair<checksum256, uint32_t>, size_t> pending_vouts;
     auto pending_transactions = parsing_progress->num_transactions - parsing_progress->parsed_transactions;
     while (pending_transactions-- && process_row) {
-        bitcoin::core::transaction transaction(&block_data);
+        check(reader.load_transaction(position), "4007:utxomng.xsat::processblock: missing block data");
+        eosio::datastream<const char*> block_stream(reader.data.data(), reader.data.size());
+        block_stream.seekp(position);
+        bitcoin::core::transaction_view transaction(&reader.data);
         block_stream >> transaction;
-        auto txid = bitcoin::be_checksum256_from_uint(transaction.merkle_hash());
+
+        // txid hashing
+        const auto hash_weight = (transaction.to - transaction.from) * WEIGHT_PER_HASHED_BYTE;
+        if (!within_budget(hash_weight + WEIGHT_PER_UTXO_ROW))
+            break;
+        weight += hash_weight;
+
+        auto txid = bitcoin::be_checksum256_from_uint(transaction.merkle_hash(txid_buffer));
+        const auto is_coinbase = transaction.is_coinbase();
 
         // save vin
-        for (; parsing_progress->parsed_vin < transaction.inputs.size() && process_row;
+        bitcoin::core::input_view vin;
+        auto vin_offset = transaction.input_offset(parsing_progress->parsed_vin);
+        for (; parsing_progress->parsed_vin < transaction.num_inputs && process_row
+               && within_budget(WEIGHT_PER_INPUT + WEIGHT_PER_UTXO_ROW);
              parsing_progress->parsed_vin++, process_row--) {
-            auto vin = transaction.inputs[parsing_progress->parsed_vin];
-            if (transaction.is_coinbase())
+            vin_offset = transaction.read_input(vin_offset, vin);
+            weight += WEIGHT_PER_INPUT + WEIGHT_PER_UTXO_ROW;
+            processed_rows++;
+            if (is_coinbase)
                 continue;
 
-            save_pending_utxo(height, hash, bitcoin::be_checksum256_from_uint(vin.previous_output_hash),
-                              vin.previous_output_index, script_data, 0, "vin"_n);
             parsing_progress->num_utxos++;
+            auto prev_txid = bitcoin::be_checksum256_from_uint(vin.previous_output_hash);
+
+            // the output was created earlier in this block, it never reaches the utxos table
+            auto pending_vout_itr = pending_vouts.find({prev_txid, vin.previous_output_index});
+            if (pending_vout_itr != pending_vouts.end()) {
+                pending_utxos[pending_vout_itr->second].type = "spent"_n;
+                pending_vouts.erase(pending_vout_itr);
+                continue;
+            }
+            if (index_pending_utxos
+                && spend_pending_vout(parsing_progress->bucket_id, prev_txid, vin.previous_output_index)) {
+                continue;
+            }
+
+            pending_utxos.push_back({.txid = prev_txid, .index = vin.previous_output_index, .type = "vin"_n});
         }
 
         // save vout
-        for (; parsing_progress->parsed_vout < transaction.outputs.size() && process_row;
+        bitcoin::core::output_view vout;
+        auto vout_offset = transaction.output_offset(parsing_progress->parsed_vout);
+        for (; parsing_progress->parsed_vout < transaction.num_outputs && process_row
+               && within_budget(WEIGHT_PER_OUTPUT + WEIGHT_PER_UTXO_ROW);
              parsing_progress->parsed_vout++, process_row--) {
-            auto vout = transaction.outputs[parsing_progress->parsed_vout];
+            vout_offset = transaction.read_output(vout_offset, vout);
+            weight += WEIGHT_PER_OUTPUT + WEIGHT_PER_UTXO_ROW;
+            processed_rows++;
 
-            if (xsat::utils::is_unspendable_legacy(vout.script.data))
+            if (xsat::utils::is_unspendable_legacy(vout.script.data, vout.script.size))
                 continue;
-            save_pending_utxo(height, hash, txid, parsing_progress->parsed_vout, vout.script.data, vout.value,
-                              "vout"_n);
+            std::vector<uint8_t> script_data;
+            const auto script_type = bitcoin::compress_script(vout.script.to_vector(), script_data);
+            pending_vouts[{txid, (uint32_t)parsing_progress->parsed_vout}] = pending_utxos.size();
+            pending_utxos.push_back({.txid = txid,
+                                     .index = (uint32_t)parsing_progress->parsed_vout,
+                                     .scriptpubkey = script_data,
+                                     .value = vout.value,
+                                     .type = "vout"_n,
+                                     .script_type = script_type});
             parsing_progress->num_utxos++;
         }
 
         // next transaction
-        if (parsing_progress->parsed_vin == transaction.inputs.size()
-            && parsing_progress->parsed_vout == transaction.outputs.size()) {
-            parsed_position = block_stream.tellp();
+        if (parsing_progress->parsed_vin == transaction.num_inputs
+            && parsing_progress->parsed_vout == transaction.num_outputs) {
+            position = block_stream.tellp();
+            parsed_position = position;
             parsing_progress->parsed_vin = 0;
             parsing_progress->parsed_vout = 0;
             parsing_progress->parsed_transactions++;
         }
     }
     parsing_progress->parsed_position += parsed_position;
+
+    if (!pending_utxos.empty()) {
+        save_pending_utxos(parsing_progress->bucket_id, range, pending_utxos, index_pending_utxos);
+    }
+}
+
+bool utxo_manage::init_parse_ranges(utxo_manage::parsing_progress_row& parsing_progress) {
+    block_sync::tx_offset_table _tx_offset(BLOCK_SYNC_CONTRACT, parsing_progress.bucket_id);
+    if (!_tx_offset.exists())
+        return false;
+    const auto tx_offsets = _tx_offset.get().offsets;
+
+    // num_transactions varint (at most 9 bytes)
+    block_sync::bucket_reader reader(BLOCK_SYNC_CONTRACT, parsing_progress.bucket_id, BLOCK_CHUNK, BLOCK_HEADER_SIZE);
+    reader.load(9);
+    eosio::datastream<const char*> block_stream(reader.data.data(), reader.data.size());
+    parsing_progress.num_transactions = bitcoin::varint::decode(block_stream);
+
+    // range 0 starts after the varint and is held by the block parser
+    parse_range_table _parse_range(get_self(), parsing_progress.bucket_id);
+    uint64_t from_transaction = 0;
+    uint64_t parsed_position = block_stream.tellp();
+    for (uint64_t range = 0; range <= tx_offsets.size(); range++) {
+        const auto to_transaction
+            = range < tx_offsets.size() ? tx_offsets[range].transaction : parsing_progress.num_transactions;
+        _parse_range.emplace(get_self(), [&](auto& row) {
+            row.id = range;
+            row.from_transaction = from_transaction;
+            row.progress = {.bucket_id = parsing_progress.bucket_id,
+                            .num_transactions = to_transaction - from_transaction,
+                            .parsed_position = parsed_position};
+            if (range == 0) {
+                row.progress.parser = parsing_progress.parser;
+                row.progress.parse_expiration_time = parsing_progress.parse_expiration_time;
+            }
+        });
+        if (range < tx_offsets.size()) {
+            from_transaction = to_transaction;
+            parsed_position = tx_offsets[range].position - BLOCK_HEADER_SIZE;
+        }
+    }
+    return true;
+}
+
+utxo_manage::parse_range_table::const_iterator utxo_manage::find_parse_range(parse_range_table& _parse_range,
+                                                                             const name& synchronizer,
+                                                                             const time_point& current_time) {
+    auto claimable_itr = _parse_range.end();
+    for (auto itr = _parse_range.begin(); itr != _parse_range.end(); itr++) {
+        const auto& progress = itr->progress;
+        if (progress.parsed_transactions == progress.num_transactions)
+            continue;
+        if (progress.parser == synchronizer)
+            return itr;
+        if (claimable_itr == _parse_range.end()
+            && (!progress.parser || progress.parse_expiration_time <= current_time)) {
+            claimable_itr = itr;
+        }
+    }
+    return claimable_itr;
+}
+
+void utxo_manage::parse_range(const uint64_t height, const checksum256& hash, const name& synchronizer,
+                              utxo_manage::parsing_progress_row* parsing_progress, uint64_t process_row,
+                              const utxo_manage::config_row& config) {
+    const auto current_time = current_time_point();
+    parse_range_table _parse_range(get_self(), parsing_progress->bucket_id);
+    auto parse_range_itr = find_parse_range(_parse_range, synchronizer, current_time);
+    check(parse_range_itr != _parse_range.end(),
+          "4008:utxomng.xsat::processblock: all ranges of the current block are being parsed");
+
+    auto progress = parse_range_itr->progress;
+    if (progress.parser != synchronizer) {
+        progress.parser = synchronizer;
+        progress.parse_expiration_time = current_time + eosio::seconds(config.parse_timeout_seconds);
+    }
+    const auto parsed_transactions = progress.parsed_transactions;
+    const auto num_utxos = progress.num_utxos;
+    parsing_transactions(height, hash, parse_range_itr->id, &progress, process_row, config.parse_budget.value_or(0),
+                         config.index_pending_utxos.value_or(false));
+    _parse_range.modify(parse_range_itr, same_payer, [&](auto& row) {
+        row.progress = progress;
+    });
+
+    // the block progress sums up its ranges
+    parsing_progress->parsed_transactions += progress.parsed_transactions - parsed_transactions;
+    parsing_progress->num_utxos += progress.num_utxos - num_utxos;
 }
 
 void utxo_manage::migrate(utxo_manage::chain_state_row& chain_state, uint64_t process_row) {
@@ -476,30 +890,75 @@ void utxo_manage::migrate(utxo_manage::chain_state_row& chain_state, uint64_t pr
     auto start_itr = pending_utxo_idx.lower_bound(block_id);
     auto end_itr = pending_utxo_idx.upper_bound(block_id);
 
-    auto utxo_idx = _utxo.get_index<"byutxoid"_n>();
-    while (start_itr != end_itr && process_row--) {
-        if (start_itr->type == "vin"_n) {
-            auto prev_utxo = remove_utxo(utxo_idx, start_itr->txid, start_itr->index);
-            if (prev_utxo.has_value()) {
-                chain_state.num_utxos -= 1;
-
-                // migrate to utxo  table
-                save_spent_utxo(start_itr->height, *prev_utxo);
-            }
-        } else {
-            save_utxo(start_itr->txid, start_itr->index, start_itr->scriptpubkey, start_itr->value);
-            chain_state.num_utxos += 1;
-        }
+    // legacy pendingutxos rows first
+    while (start_itr != end_itr && process_row) {
+        migrate_pending_utxo(chain_state, {.txid = start_itr->txid,
+                                           .index = start_itr->index,
+                                           .scriptpubkey = start_itr->scriptpubkey,
+                                           .value = start_itr->value,
+                                           .type = start_itr->type,
+                                           .script_type = start_itr->script_type.value_or(0)});
 
         // erase pending utxo
         start_itr = pending_utxo_idx.erase(start_itr);
+        process_row--;
+    }
 
+    // pendingpages in parsing order
+    auto consensus_block_idx = _consensus_block.get_index<"byblockid"_n>();
+    auto consensus_block_itr = consensus_block_idx.require_find(block_id);
+    pending_page_table _pending_page(get_self(), consensus_block_itr->bucket_id);
+    auto page_itr = _pending_page.begin();
+    while (page_itr != _pending_page.end() && process_row) {
+        auto migrated = page_itr->migrated;
+        while (migrated < page_itr->utxos.size() && process_row) {
+            migrate_pending_utxo(chain_state, page_itr->utxos[migrated++]);
+            process_row--;
+        }
+
+        if (migrated < page_itr->utxos.size()) {
+            _pending_page.modify(page_itr, same_payer, [&](auto& row) {
+                row.migrated = migrated;
+            });
+            break;
+        }
+        page_itr = _pending_page.erase(page_itr);
+    }
+}
+
+void utxo_manage::migrate_pending_utxo(utxo_manage::chain_state_row& chain_state,
+                                       const utxo_manage::pending_utxo& utxo) {
+    if (utxo.type == "vin"_n) {
+        auto prev_utxo = remove_utxo(chain_state, utxo.txid, utxo.index);
+        if (prev_utxo.has_value()) {
+            chain_state.num_utxos -= 1;
+
+            // migrate to utxo  table
+            save_spent_utxo(chain_state, *prev_utxo);
+        }
+    } else if (utxo.type == "spent"_n) {
+        // created and spent in the same block, only the spent history is saved
+        save_spent_utxo(chain_state, {.txid = utxo.txid,
+                                      .index = utxo.index,
+                                      .scriptpubkey = utxo.scriptpubkey,
+                                      .value = utxo.value,
+                                      .script_type = utxo.script_type});
+
+        // the row stands for both the vout and the vin
         chain_state.migrated_num_utxos++;
+    } else {
+        save_utxo(chain_state, utxo.txid, utxo.index, utxo.script_type, utxo.scriptpubkey, utxo.value);
+        chain_state.num_utxos += 1;
     }
+
+    chain_state.migrated_num_utxos++;
 }
 
 void utxo_manage::delete_data(utxo_manage::chain_state_row& chain_state, const uint16_t retained_spent_utxo_blocks,
                               const uint16_t num_retain_data_blocks, uint64_t process_row) {
+    if (process_row == 0)
+        process_row = -1;
+
     // Batch delete forked pendingutxos
     auto pending_utxo_idx = _pending_utxo.get_index<"byheight"_n>();
     auto pending_utxo_itr = pending_utxo_idx.lower_bound(chain_state.migrating_height);
@@ -511,6 +970,16 @@ void utxo_manage::delete_data(utxo_manage::chain_state_row& chain_state, const u
         return;
     }
 
+    // Batch delete pendingpages and pendingindex of all blocks of the migrating height
+    auto pending_block_idx = _consensus_block.get_index<"byheight"_n>();
+    auto pending_block_itr = pending_block_idx.lower_bound(chain_state.migrating_height);
+    auto pending_block_end = pending_block_idx.upper_bound(chain_state.migrating_height);
+    for (; pending_block_itr != pending_block_end; pending_block_itr++) {
+        if (erase_pending_utxos(pending_block_itr->bucket_id, process_row)) {
+            return;
+        }
+    }
+
     // Delete spentutxos in batches
     auto del_history_height = chain_state.migrating_height - retained_spent_utxo_blocks;
     auto spent_utxo_idx = _spent_utxo.get_index<"byheight"_n>();
@@ -529,6 +998,10 @@ void utxo_manage::delete_data(utxo_manage::chain_state_row& chain_state, const u
     block_endorse::erase_action _erase(BLOCK_ENDORSE_CONTRACT, {get_self(), "active"_n});
     _erase.send(chain_state.migrating_height);
 
+    // erase block sync data of the irreversible height
+    block_sync::erase_action _sync_erase(BLOCK_SYNC_CONTRACT, {get_self(), "active"_n});
+    _sync_erase.send(chain_state.migrating_height);
+
     // erase old block chunks
     auto del_height = chain_state.migrating_height - num_retain_data_blocks;
     auto block_extra_itr = _block_extra.find(del_height);
@@ -553,6 +1026,13 @@ void utxo_manage::delete_data(utxo_manage::chain_state_row& chain_state, const u
         consensus_block_itr = consensus_block_idx.erase(consensus_block_itr);
     }
 
+    // erase branches whose blocks have all been erased
+    auto branch_idx = _branch.get_index<"bytipheight"_n>();
+    auto branch_itr = branch_idx.begin();
+    while (branch_itr != branch_idx.end() && branch_itr->tip_height <= chain_state.migrating_height) {
+        branch_itr = branch_idx.erase(branch_itr);
+    }
+
     // save irreversible block
     _block.emplace(get_self(), [&](auto& row) {
         row.height = consensus_block.height;
@@ -565,11 +1045,19 @@ void utxo_manage::delete_data(utxo_manage::chain_state_row& chain_state, const u
         row.bits = consensus_block.bits;
         row.nonce = consensus_block.nonce;
     });
+    save_header({.height = consensus_block.height,
+                 .hash = consensus_block.hash,
+                 .previous_block_hash = consensus_block.previous_block_hash,
+                 .cumulative_work = consensus_block.cumulative_work,
+                 .timestamp = consensus_block.timestamp,
+                 .bits = consensus_block.bits},
+                true);
 
     // save block extra
     _block_extra.emplace(get_self(), [&](auto& row) {
         row.height = chain_state.migrating_height;
         row.bucket_id = consensus_block.bucket_id;
+        row.utxo_set_hash = chain_state.utxo_set_hash.value_or(checksum256());
     });
 
     // next action
@@ -594,14 +1082,46 @@ void utxo_manage::find_set_next_parsable_block(utxo_manage::chain_state_row& cha
         } else if (chain_state.parsing_height != consensus_block_itr->height) {
             break;
         }
-        chain_state.parsing_progress_of[consensus_block_itr->hash]
-            = {.bucket_id = consensus_block_itr->bucket_id,
-               .parser = consensus_block_itr->synchronizer,
-               .parse_expiration_time = current_time_point() + eosio::seconds(parse_timeout_seconds)};
+        set_parsing_progress(consensus_block_itr->hash,
+                             {.bucket_id = consensus_block_itr->bucket_id,
+                              .parser = consensus_block_itr->synchronizer,
+                              .parse_expiration_time = current_time_point() + eosio::seconds(parse_timeout_seconds)});
         consensus_block_itr++;
     }
 }
 
+void utxo_manage::set_parsing_progress(const checksum256& hash, const parsing_progress_row& parsing_progress) {
+    auto block_parsing_itr = _block_parsing.find(parsing_progress.bucket_id);
+    if (block_parsing_itr == _block_parsing.end()) {
+        _block_parsing.emplace(get_self(), [&](auto& row) {
+            row.bucket_id = parsing_progress.bucket_id;
+            row.hash = hash;
+            row.progress = parsing_progress;
+        });
+    } else {
+        _block_parsing.modify(block_parsing_itr, same_payer, [&](auto& row) {
+            row.hash = hash;
+            row.progress = parsing_progress;
+        });
+    }
+}
+
+void utxo_manage::upgrade_chain_state(chain_state_row& chain_state) {
+    for (const auto& it : chain_state.parsing_progress_of) {
+        set_parsing_progress(it.first, it.second);
+    }
+    chain_state.parsing_progress_of.clear();
+
+    // binary extensions are serialized in order, both are present once the first one is written
+    // the table end is only probed for the first row after an upgrade
+    if (!chain_state.next_spent_utxo_id.has_value()) {
+        chain_state.next_spent_utxo_id = std::max<uint64_t>(_spent_utxo.available_primary_key(), 1);
+    }
+    if (!chain_state.utxo_set_hash.has_value()) {
+        chain_state.utxo_set_hash = checksum256();
+    }
+}
+
 void utxo_manage::find_set_next_irreversible_block(utxo_manage::chain_state_row& chain_state) {
     // Verify whether the next irreversible block needs to be migrated
     if (chain_state.migrating_height != 0
@@ -630,6 +1150,29 @@ void utxo_manage::find_set_next_irreversible_block(utxo_manage::chain_state_row&
     });
 }
 
+void utxo_manage::save_header(const bitcoin::core::block& block, const bool overwrite) {
+    auto header_ring_itr = _header_ring.find(block.height % HEADER_RING_SIZE);
+    if (header_ring_itr == _header_ring.end()) {
+        _header_ring.emplace(get_self(), [&](auto& row) {
+            row.height = block.height;
+            row.hash = block.hash;
+            row.previous_block_hash = block.previous_block_hash;
+            row.cumulative_work = block.cumulative_work;
+            row.timestamp = block.timestamp;
+            row.bits = block.bits;
+        });
+    } else if (overwrite || header_ring_itr->height != block.height) {
+        _header_ring.modify(header_ring_itr, same_payer, [&](auto& row) {
+            row.height = block.height;
+            row.hash = block.hash;
+            row.previous_block_hash = block.previous_block_hash;
+            row.cumulative_work = block.cumulative_work;
+            row.timestamp = block.timestamp;
+            row.bits = block.bits;
+        });
+    }
+}
+
 utxo_manage::consensus_block_row utxo_manage::find_next_irreversible_block(const uint64_t irreversible_height,
                                                                            const checksum256& irreversible_hash) {
     const auto err_msg = "4006:utxomng.xsat::processblock: next irreversible block not found";
@@ -644,6 +1187,30 @@ utxo_manage::consensus_block_row utxo_manage::find_next_irreversible_block(const
         return *next_irreversible_itr;
     }
 
+    // Walk from the tip with the largest cumulative work down to the branch containing the next block
+    auto branch_idx = _branch.get_index<"bywork"_n>();
+    auto branch_itr = branch_idx.rbegin();
+    if (branch_itr != branch_idx.rend()) {
+        auto branch_id = branch_itr->id;
+        auto start_height = branch_itr->start_height;
+        auto parent_id = branch_itr->parent_id;
+        while (start_height > irreversible_height + 1 && parent_id != 0) {
+            auto parent_branch_itr = _branch.find(parent_id);
+            if (parent_branch_itr == _branch.end()) {
+                break;
+            }
+            branch_id = parent_branch_itr->id;
+            start_height = parent_branch_itr->start_height;
+            parent_id = parent_branch_itr->parent_id;
+        }
+        for (auto itr = next_irreversible_itr; itr != next_irreversible_end; itr++) {
+            if (itr->branch_id.value_or(0) == branch_id && itr->previous_block_hash == irreversible_hash) {
+                return *itr;
+            }
+        }
+    }
+
+    // Blocks saved before the fork tree existed
     // Find the parent block with the largest cumulative work after 6 blocks
     consensus_block_row parent;
     auto parent_height = irreversible_height + IRREVERSIBLE_BLOCKS;
@@ -670,46 +1237,161 @@ utxo_manage::consensus_block_row utxo_manage::find_next_irreversible_block(const
     return *irreversible_block;
 }
 
-void utxo_manage::save_spent_utxo(const uint64_t height, const utxo_manage::utxo_row& utxo) {
-    auto id = _spent_utxo.available_primary_key();
-    if (id == 0) {
-        id = 1;
+uint64_t utxo_manage::save_branch(const uint64_t bucket_id, const uint64_t height, const checksum256& hash,
+                                  const checksum256& previous_block_hash, const checksum256& cumulative_work) {
+    // extend the branch of the parent if the parent is its tip
+    auto block_id_idx = _consensus_block.get_index<"byblockid"_n>();
+    auto parent_itr = block_id_idx.find(xsat::utils::compute_block_id(height - 1, previous_block_hash));
+    uint64_t parent_id = 0;
+    if (parent_itr != block_id_idx.end() && parent_itr->branch_id.has_value()) {
+        parent_id = parent_itr->branch_id.value();
+        auto branch_itr = _branch.find(parent_id);
+        if (branch_itr != _branch.end() && branch_itr->tip_height == parent_itr->height
+            && branch_itr->tip_hash == parent_itr->hash) {
+            _branch.modify(branch_itr, same_payer, [&](auto& row) {
+                row.tip_height = height;
+                row.tip_hash = hash;
+                row.cumulative_work = cumulative_work;
+            });
+            return parent_id;
+        }
     }
+
+    // otherwise start a new branch
+    _branch.emplace(get_self(), [&](auto& row) {
+        row.id = bucket_id;
+        row.parent_id = parent_id;
+        row.start_height = height;
+        row.tip_height = height;
+        row.tip_hash = hash;
+        row.cumulative_work = cumulative_work;
+    });
+    return bucket_id;
+}
+
+void utxo_manage::save_spent_utxo(utxo_manage::chain_state_row& chain_state, const utxo_manage::utxo_row& utxo) {
+    const auto id = chain_state.next_spent_utxo_id.value();
+    chain_state.next_spent_utxo_id = id + 1;
+
     _spent_utxo.emplace(get_self(), [&](auto& row) {
         row.id = id;
-        row.height = height;
+        row.height = chain_state.migrating_height;
         row.txid = utxo.txid;
         row.index = utxo.index;
-        row.scriptpubkey = utxo.scriptpubkey;
+        row.scriptpubkey = utxo.get_scriptpubkey();
         row.value = utxo.value;
     });
 }
 
-void utxo_manage::save_pending_utxo(const uint64_t height, const checksum256& hash, const checksum256& txid,
-                                    const uint32_t index, const std::vector<uint8_t>& script_data, const uint64_t value,
-                                    const name& type) {
-    auto id = _pending_utxo.available_primary_key();
-    if (id == 0) {
-        id = 1;
+void utxo_manage::save_pending_utxos(const uint64_t bucket_id, const uint64_t range,
+                                     const std::vector<utxo_manage::pending_utxo>& pending_utxos,
+                                     const bool index_pending_utxos) {
+    pending_page_table _pending_page(get_self(), bucket_id);
+    pending_index_table _pending_index(get_self(), bucket_id);
+
+    // continue on the last page of the range while it is not full
+    uint64_t page = range << 32;
+    auto page_itr = _pending_page.lower_bound((range + 1) << 32);
+    if (page_itr != _pending_page.begin() && (--page_itr)->page >= page) {
+        page = page_itr->page;
+        if (page_itr->utxos.size() >= PENDING_PAGE_SIZE) {
+            page++;
+            page_itr = _pending_page.end();
+        }
+    } else {
+        page_itr = _pending_page.end();
     }
-    _pending_utxo.emplace(get_self(), [&](auto& row) {
-        row.id = id;
-        row.height = height;
-        row.hash = hash;
-        row.txid = txid;
-        row.index = index;
-        row.scriptpubkey = script_data;
-        row.value = value;
-        row.type = type;
+
+    size_t from = 0;
+    while (from < pending_utxos.size()) {
+        const size_t slot = page_itr == _pending_page.end() ? 0 : page_itr->utxos.size();
+        const size_t to = std::min<size_t>(pending_utxos.size(), from + PENDING_PAGE_SIZE - slot);
+        if (page_itr == _pending_page.end()) {
+            _pending_page.emplace(get_self(), [&](auto& row) {
+                row.page = page;
+                row.utxos.assign(pending_utxos.begin() + from, pending_utxos.begin() + to);
+            });
+        } else {
+            _pending_page.modify(page_itr, same_payer, [&](auto& row) {
+                row.utxos.insert(row.utxos.end(), pending_utxos.begin() + from, pending_utxos.begin() + to);
+            });
+        }
+
+        if (index_pending_utxos) {
+            for (auto i = from; i < to; i++) {
+                if (pending_utxos[i].type != "vout"_n)
+                    continue;
+                const auto id
+                    = compute_utxo_key(xsat::utils::compute_utxo_id(pending_utxos[i].txid, pending_utxos[i].index));
+                if (_pending_index.find(id) != _pending_index.end())
+                    continue;
+                _pending_index.emplace(get_self(), [&](auto& row) {
+                    row.id = id;
+                    row.page = page;
+                    row.slot = slot + i - from;
+                });
+            }
+        }
+
+        from = to;
+        page++;
+        page_itr = _pending_page.end();
+    }
+}
+
+bool utxo_manage::spend_pending_vout(const uint64_t bucket_id, const checksum256& txid, const uint32_t index) {
+    pending_index_table _pending_index(get_self(), bucket_id);
+    auto pending_index_itr = _pending_index.find(compute_utxo_key(xsat::utils::compute_utxo_id(txid, index)));
+    if (pending_index_itr == _pending_index.end())
+        return false;
+
+    pending_page_table _pending_page(get_self(), bucket_id);
+    auto page_itr = _pending_page.find(pending_index_itr->page);
+    if (page_itr == _pending_page.end())
+        return false;
+
+    const auto slot = pending_index_itr->slot;
+    const auto& utxo = page_itr->utxos[slot];
+    if (utxo.txid != txid || utxo.index != index || utxo.type != "vout"_n)
+        return false;
+
+    _pending_page.modify(page_itr, same_payer, [&](auto& row) {
+        row.utxos[slot].type = "spent"_n;
     });
+    _pending_index.erase(pending_index_itr);
+    return true;
+}
+
+bool utxo_manage::erase_pending_utxos(const uint64_t bucket_id, uint64_t& process_row) {
+    pending_page_table _pending_page(get_self(), bucket_id);
+    pending_index_table _pending_index(get_self(), bucket_id);
+    parse_range_table _parse_range(get_self(), bucket_id);
+    auto page_itr = _pending_page.begin();
+    auto pending_index_itr = _pending_index.begin();
+    auto parse_range_itr = _parse_range.begin();
+    while (page_itr != _pending_page.end() && process_row > 0) {
+        page_itr = _pending_page.erase(page_itr);
+        process_row--;
+    }
+    while (pending_index_itr != _pending_index.end() && process_row > 0) {
+        pending_index_itr = _pending_index.erase(pending_index_itr);
+        process_row--;
+    }
+    while (parse_range_itr != _parse_range.end() && process_row > 0) {
+        parse_range_itr = _parse_range.erase(parse_range_itr);
+        process_row--;
+    }
+    return page_itr != _pending_page.end() || pending_index_itr != _pending_index.end()
+           || parse_range_itr != _parse_range.end();
 }
 
-utxo_manage::utxo_row utxo_manage::save_utxo(const checksum256& txid, const uint32_t index,
+utxo_manage::utxo_row utxo_manage::save_utxo(utxo_manage::chain_state_row& chain_state, const checksum256& txid,
+                                             const uint32_t index, const uint8_t script_type,
                                              const std::vector<uint8_t>& script_data, const uint64_t value) {
-    //  save output
-    auto id = _utxo.available_primary_key();
-    if (id == 0) {
-        id = 1;
+    //  save output, keyed by the outpoint digest and probing forward on collision
+    auto id = compute_utxo_key(xsat::utils::compute_utxo_id(txid, index));
+    while (_utxo.find(id) != _utxo.end()) {
+        id++;
     }
     auto utxo_itr = _utxo.emplace(get_self(), [&](auto& row) {
         row.id = id;
@@ -717,17 +1399,94 @@ utxo_manage::utxo_row utxo_manage::save_utxo(const checksum256& txid, const uint
         row.index = index;
         row.scriptpubkey = script_data;
         row.value = value;
+        row.script_type = script_type;
+        row.counted = true;
     });
+    update_utxo_set_hash(chain_state, *utxo_itr, false);
+    update_balance(chain_state, *utxo_itr, false);
     return *utxo_itr;
 }
 
-template <typename IDX>
-optional<utxo_manage::utxo_row> utxo_manage::remove_utxo(IDX& utxo_idx, const checksum256& prev_txid,
-                                                         const uint32_t prev_index) {
-    auto utxo_itr = utxo_idx.find(xsat::utils::compute_utxo_id(prev_txid, prev_index));
-    if (utxo_itr != utxo_idx.end()) {
+utxo_manage::utxo_table::const_iterator utxo_manage::find_utxo(const checksum256& txid, const uint32_t index) {
+    const auto utxo_id = xsat::utils::compute_utxo_id(txid, index);
+    auto utxo_itr = _utxo.find(compute_utxo_key(utxo_id));
+    if (utxo_itr != _utxo.end() && utxo_itr->txid == txid && utxo_itr->index == index) {
+        return utxo_itr;
+    }
+
+    // probed keys after a digest collision, and rows imported with sequential ids
+    auto utxo_idx = _utxo.get_index<"byutxoid"_n>();
+    auto utxo_id_itr = utxo_idx.find(utxo_id);
+    if (utxo_id_itr == utxo_idx.end()) {
+        return _utxo.end();
+    }
+    return _utxo.iterator_to(*utxo_id_itr);
+}
+
+void utxo_manage::update_utxo_set_hash(utxo_manage::chain_state_row& chain_state, const utxo_manage::utxo_row& utxo,
+                                       const bool removed) {
+    // utxos saved before the upgrade are not in the hash until `countutxos` adds them
+    if (removed && !utxo.counted.value_or(false)) {
+        return;
+    }
+    const auto utxo_set_hash = bitcoin::be_uint_from_checksum256(chain_state.utxo_set_hash.value());
+    const auto utxo_hash = bitcoin::be_uint_from_checksum256(compute_utxo_hash(utxo));
+    chain_state.utxo_set_hash
+        = bitcoin::be_checksum256_from_uint(removed ? utxo_set_hash - utxo_hash : utxo_set_hash + utxo_hash);
+}
+
+void utxo_manage::update_balance(const utxo_manage::chain_state_row& chain_state, const utxo_manage::utxo_row& utxo,
+                                 const bool removed) {
+    // imported utxos belong to the snapshot at START_HEIGHT
+    const auto height = chain_state.migrating_height > 0 ? chain_state.migrating_height : START_HEIGHT;
+    const auto scripthash = utxo.by_scriptpubkey();
+    auto balance_idx = _balance.get_index<"byscript"_n>();
+    auto balance_itr = balance_idx.find(scripthash);
+    if (removed) {
+        // utxos saved before the table existed are not counted
+        if (!utxo.counted.value_or(false)) {
+            return;
+        }
+        check(balance_itr != balance_idx.end() && balance_itr->num_utxos > 0 && balance_itr->value >= utxo.value,
+              "utxomng.xsat::update_balance: balance underflow");
+        if (balance_itr->num_utxos == 1) {
+            balance_idx.erase(balance_itr);
+        } else {
+            balance_idx.modify(balance_itr, same_payer, [&](auto& row) {
+                row.value -= utxo.value;
+                row.num_utxos -= 1;
+                row.height = height;
+            });
+        }
+    } else if (balance_itr == balance_idx.end()) {
+        auto id = compute_utxo_key(scripthash);
+        while (_balance.find(id) != _balance.end()) {
+            id++;
+        }
+        _balance.emplace(get_self(), [&](auto& row) {
+            row.id = id;
+            row.scripthash = scripthash;
+            row.value = utxo.value;
+            row.num_utxos = 1;
+            row.height = height;
+        });
+    } else {
+        balance_idx.modify(balance_itr, same_payer, [&](auto& row) {
+            row.value += utxo.value;
+            row.num_utxos += 1;
+            row.height = height;
+        });
+    }
+}
+
+optional<utxo_manage::utxo_row> utxo_manage::remove_utxo(utxo_manage::chain_state_row& chain_state,
+                                                         const checksum256& prev_txid, const uint32_t prev_index) {
+    auto utxo_itr = find_utxo(prev_txid, prev_index);
+    if (utxo_itr != _utxo.end()) {
         auto found_utxo = *utxo_itr;
-        utxo_idx.erase(utxo_itr);
+        update_utxo_set_hash(chain_state, found_utxo, true);
+        update_balance(chain_state, found_utxo, true);
+        _utxo.erase(utxo_itr);
         return found_utxo;
     } else {
         // log
@@ -4,6 +4,8 @@
 #include <eosio/eosio.hpp>
 #include <eosio/singleton.hpp>
 #include <eosio/crypto.hpp>
+#include <eosio/binary_extension.hpp>
+#include <bitcoin/script/compressor.hpp>
 #include "../internal/defines.hpp"
 #include "../internal/utils.hpp"
 
@@ -102,8 +104,14 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
      * - `{name} parser` - the account number of the parsing block
      * - `{uint64_t} parsed_height` - parsed block height
      * - `{uint64_t} parsing_height` - the current height being parsed
-     * - `{map<checksum256, parsing_progress_row>} parsing_progress_of` - parsing progress @see `parsing_progress_row`
-     * - `{uint8_t} status` - parsing status @see `parsing_status`
+     * - `{map<checksum256, parsing_progress_row>} parsing_progress_of` - legacy, always empty, the parsing progress is
+     * stored in `parsingprogs`
+     * - `{uint8_t} status` - status of the migrating block, otherwise `parsing` while a block is being parsed @see `parsing_status`
+     * - `{binary_extension<uint64_t>} next_spent_utxo_id` - id of the next `spentutxos` row
+     * - `{binary_extension<checksum256>} utxo_set_hash` - sum modulo 2^256 of `compute_utxo_hash` of the `counted`
+     * utxos, independent of the order in which they were added and removed. It starts at zero when a deployment is
+     * upgraded, utxos saved before then are added by `countutxos` and the hash commits to the whole utxo set only
+     * once `countutxos` has returned its last page
      *
      * ### example
      *
@@ -124,22 +132,10 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
      *   "parser": "alice",
      *   "parsed_height": 840008,
      *   "parsing_height": 840009,
-     *   "parsing_progress_of": [{
-     *       "first": "00000000000000000000c6075e66b667adcdb8935e6d9a877f5cf140c806ae87",
-     *       "second": {
-     *           "bucket_id": 11,
-     *           "num_utxos": 0,
-     *           "num_transactions": 0,
-     *           "parsed_transactions": 0,
-     *           "parsed_position": 0,
-     *           "parsed_vin": 0,
-     *           "parsed_vout": 0,
-     *           "parser": "alice",
-     *           "parse_expiration_time": "2024-08-08T02:44:43"
-     *       }
-     *       }
-     *   ],
-     *   "status": 5
+     *   "parsing_progress_of": [],
+     *   "status": 5,
+     *   "next_spent_utxo_id": 35211,
+     *   "utxo_set_hash": "5a0e0cd5b1f4c1a2e1e6a1d8f3b7c0e9d2a4f6b8c0e2d4f6a8b0c2e4f6a8b0c2"
      * }
      * ```
      */
@@ -161,9 +157,51 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
         uint64_t parsing_height;
         map<checksum256, parsing_progress_row> parsing_progress_of;
         parsing_status status;
+        binary_extension<uint64_t> next_spent_utxo_id;
+        binary_extension<checksum256> utxo_set_hash;
     };
     typedef eosio::singleton<"chainstate"_n, chain_state_row> chain_state_table;
 
+    /**
+     * ## TABLE `parsingprogs`
+     *
+     * > Parsing progress of the consensus blocks at `parsing_height`, one row per fork.
+     *
+     * ### scope `get_self()`
+     * ### params
+     *
+     * - `{uint64_t} bucket_id` - primary key, bucket_id of the consensus block
+     * - `{checksum256} hash` - block hash
+     * - `{parsing_progress_row} progress` - parsing progress @see `parsing_progress_row`
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "bucket_id": 11,
+     *   "hash": "00000000000000000000c6075e66b667adcdb8935e6d9a877f5cf140c806ae87",
+     *   "progress": {
+     *       "bucket_id": 11,
+     *       "num_utxos": 0,
+     *       "num_transactions": 0,
+     *       "parsed_transactions": 0,
+     *       "parsed_position": 0,
+     *       "parsed_vin": 0,
+     *       "parsed_vout": 0,
+     *       "parser": "alice",
+     *       "parse_expiration_time": "2024-08-08T02:44:43"
+     *   }
+     * }
+     * ```
+     */
+    struct [[eosio::table]] block_parsing_row {
+        uint64_t bucket_id;
+        checksum256 hash;
+        parsing_progress_row progress;
+        uint64_t primary_key() const { return bucket_id; }
+    };
+    typedef eosio::multi_index<"parsingprogs"_n, block_parsing_row> block_parsing_table;
+
     /**
      * ## TABLE `config`
      *
@@ -178,6 +216,11 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
      * - `{uint8_t} num_merkle_layer` - verify the number of merkle levels (log(num_txs_per_verification))
      * - `{uint16_t} num_miner_priority_blocks` - miners who produce blocks give priority to verifying the number of
      * blocks
+     * - `{binary_extension<uint64_t>} verification_budget` - weight budget of each verify round, 0 to use
+     * num_txs_per_verification
+     * - `{binary_extension<uint64_t>} parse_budget` - weight budget of each processblock parsing round, 0 to use
+     * process_row only
+     * - `{binary_extension<bool>} index_pending_utxos` - whether to maintain the `pendingindex` table while parsing
      *
      * ### example
      *
@@ -189,7 +232,10 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
      *   "retained_spent_utxo_blocks": 5000,
      *   "num_txs_per_verification": 1024,
      *   "num_merkle_layer": 10,
-     *   "num_miner_priority_blocks": 10
+     *   "num_miner_priority_blocks": 10,
+     *   "verification_budget": 4000000,
+     *   "parse_budget": 1000000,
+     *   "index_pending_utxos": false
      *  }
      * ```
      */
@@ -201,6 +247,9 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
         uint16_t num_txs_per_verification = 2048;
         uint8_t num_merkle_layer = 11;
         uint16_t num_miner_priority_blocks = 10;
+        binary_extension<uint64_t> verification_budget;
+        binary_extension<uint64_t> parse_budget;
+        binary_extension<bool> index_pending_utxos;
     };
     typedef eosio::singleton<"config"_n, config_row> config_table;
 
@@ -210,21 +259,27 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
      * ### scope `get_self()`
      * ### params
      *
-     * - `{uint64_t} id` - primary key
+     * - `{uint64_t} id` - primary key, the leading 8 bytes of the outpoint digest, probed forward on collision
      * - `{checksum256} txid` - transaction id
      * - `{uint32_t} index` - vout index
-     * - `{std::vector<uint8_t>} scriptpubkey` - script public key
+     * - `{std::vector<uint8_t>} scriptpubkey` - script public key, only the payload when `script_type` is not 0
      * - `{uint32_t} value` - utxo quantity
+     * - `{binary_extension<uint8_t>} script_type` - template of the compressed script public key, 0 for raw bytes,
+     * @see enum `bitcoin::script_type`
+     * - `{binary_extension<bool>} counted` - whether the utxo is counted in `balances` and
+     * `chainstate.utxo_set_hash`, absent for utxos saved before the upgrade until `countutxos` backfills them
      *
      * ### example
      *
      * ```json
      * {
-     *   "id": 2,
+     *   "id": 3104973555729820490,
      *   "txid": "2bb85f4b004be6da54f766c17c1e855187327112c231ef2ff35ebad0ea67c69e",
      *   "index": 0,
-     *   "scriptpubkey": "51203b8b3ab1453eb47e2d4903b963776680e30863df3625d3e74292338ae7928da1",
-     *   "value": 1797928002
+     *   "scriptpubkey": "3b8b3ab1453eb47e2d4903b963776680e30863df3625d3e74292338ae7928da1",
+     *   "value": 1797928002,
+     *   "script_type": 5,
+     *   "counted": true
      * }
      * ```
      */
@@ -234,19 +289,71 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
         uint32_t index;
         std::vector<uint8_t> scriptpubkey;
         uint64_t value;
+        binary_extension<uint8_t> script_type;
+        binary_extension<bool> counted;
         uint64_t primary_key() const { return id; }
-        checksum256 by_scriptpubkey() const { return xsat::utils::hash(scriptpubkey); }
+        std::vector<uint8_t> get_scriptpubkey() const {
+            return bitcoin::decompress_script(script_type.value_or(0), scriptpubkey);
+        }
+        checksum256 by_scriptpubkey() const { return xsat::utils::hash(get_scriptpubkey()); }
         checksum256 by_utxo_id() const { return xsat::utils::compute_utxo_id(txid, index); }
+        checksum256 by_script_id() const { return compute_script_id(by_scriptpubkey(), id); }
     };
     typedef eosio::multi_index<
         "utxos"_n, utxo_row,
         eosio::indexed_by<"scriptpubkey"_n, const_mem_fun<utxo_row, checksum256, &utxo_row::by_scriptpubkey>>,
-        eosio::indexed_by<"byutxoid"_n, const_mem_fun<utxo_row, checksum256, &utxo_row::by_utxo_id>>>
+        eosio::indexed_by<"byutxoid"_n, const_mem_fun<utxo_row, checksum256, &utxo_row::by_utxo_id>>,
+        eosio::indexed_by<"byscriptid"_n, const_mem_fun<utxo_row, checksum256, &utxo_row::by_script_id>>>
         utxo_table;
 
+    /**
+     * ## TABLE `balances`
+     *
+     * > Aggregated `utxos` of a scriptpubkey, maintained as utxos are saved and removed. The row is erased when the
+     * last utxo of the scriptpubkey is spent. Utxos saved before the table existed are neither counted nor subtracted
+     * when they are removed until `countutxos` backfills them @see `utxos.counted`.
+     *
+     * ### scope `get_self()`
+     * ### params
+     *
+     * - `{uint64_t} id` - primary key, the leading 8 bytes of `scripthash`, probing forward on collision
+     * - `{checksum256} scripthash` - sha256 of the scriptpubkey, the same as the `scriptpubkey` index of `utxos`
+     * - `{uint64_t} value` - total value of the utxos
+     * - `{uint64_t} num_utxos` - number of utxos
+     * - `{uint64_t} height` - height of the last change, `START_HEIGHT` for imported utxos
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "id": 7521410836413897297,
+     *   "scripthash": "68616b4e3a395a51a095185b74890179a530268e0d43bc148c98f19e4aafe449",
+     *   "value": 4075061499,
+     *   "num_utxos": 1,
+     *   "height": 840000
+     * }
+     * ```
+     */
+    struct [[eosio::table]] balance_row {
+        uint64_t id;
+        checksum256 scripthash;
+        uint64_t value;
+        uint64_t num_utxos;
+        uint64_t height;
+        uint64_t primary_key() const { return id; }
+        checksum256 by_scripthash() const { return scripthash; }
+    };
+    typedef eosio::multi_index<
+        "balances"_n, balance_row,
+        eosio::indexed_by<"byscript"_n, const_mem_fun<balance_row, checksum256, &balance_row::by_scripthash>>>
+        balance_table;
+
     /**
      * ## TABLE `pendingutxos`
      *
+     * > Legacy per-utxo pending rows, no longer written. Rows left over from before `pendingpages` are still migrated
+     * and deleted.
+     *
      * ### scope `get_self()`
      * ### params
      *
@@ -255,9 +362,12 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
      * - `{checksum256} hash` - block hash
      * - `{checksum256} txid` - transaction id
      * - `{uint32_t} index` - vout index
-     * - `{std::vector<uint8_t>} scriptpubkey` - script public key
+     * - `{std::vector<uint8_t>} scriptpubkey` - script public key, only the payload when `script_type` is not 0
      * - `{uint32_t} value` - utxo quantity
-     * - `{name} type` - utxo type (`vin` or `vout`)
+     * - `{name} type` - utxo type (`vin`, `vout`, or `spent` for a vout spent by a later transaction of the same
+     * block, which stands for both the vout and its vin and is written to `spentutxos` only)
+     * - `{binary_extension<uint8_t>} script_type` - template of the compressed script public key, 0 for raw bytes,
+     * @see enum `bitcoin::script_type`
      *
      * ### example
      *
@@ -268,9 +378,10 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
      *   "hash": "0000000000000000000320283a032748cef8227873ff4872689bf23f1cda83a5",
      *   "txid": "2bb85f4b004be6da54f766c17c1e855187327112c231ef2ff35ebad0ea67c69e",
      *   "index": 0,
-     *   "scriptpubkey": "51203b8b3ab1453eb47e2d4903b963776680e30863df3625d3e74292338ae7928da1",
+     *   "scriptpubkey": "3b8b3ab1453eb47e2d4903b963776680e30863df3625d3e74292338ae7928da1",
      *   "value": 1797928002,
-     *   "type": "vout"
+     *   "type": "vout",
+     *   "script_type": 5
      * }
      * ```
      */
@@ -282,11 +393,17 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
         uint32_t index;
         std::vector<uint8_t> scriptpubkey;
         uint64_t value;
-        name type;  // vin/vout
+        name type;  // vin/vout/spent
+        binary_extension<uint8_t> script_type;
         uint64_t primary_key() const { return id; }
         uint64_t by_height() const { return height; }
+        std::vector<uint8_t> get_scriptpubkey() const {
+            return bitcoin::decompress_script(script_type.value_or(0), scriptpubkey);
+        }
         checksum256 by_utxo_id() const { return xsat::utils::compute_utxo_id(txid, index); }
-        checksum256 by_scriptpubkey() const { return compute_scriptpubkey_id_for_block(height, hash, scriptpubkey); }
+        checksum256 by_scriptpubkey() const {
+            return compute_scriptpubkey_id_for_block(height, hash, get_scriptpubkey());
+        }
         checksum256 by_block_id() const { return xsat::utils::compute_block_id(height, hash); }
         checksum256 by_block_utxo_id() const { return compute_utxo_id_for_block(height, hash, txid, index); }
         checksum256 by_type() const { return compute_type_id_for_block(height, hash, type); }
@@ -303,6 +420,151 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
         eosio::indexed_by<"byutxoid"_n, const_mem_fun<pending_utxo_row, checksum256, &pending_utxo_row::by_utxo_id>>>
         pending_utxo_table;
 
+    /**
+     * ## STRUCT `pending_utxo`
+     *
+     * ### params
+     *
+     * - `{checksum256} txid` - transaction id
+     * - `{uint32_t} index` - vout index
+     * - `{std::vector<uint8_t>} scriptpubkey` - script public key, only the payload when `script_type` is not 0
+     * - `{uint64_t} value` - utxo quantity
+     * - `{name} type` - utxo type (`vin`, `vout` or `spent`) @see TABLE `pendingutxos`
+     * - `{uint8_t} script_type` - template of the compressed script public key, @see enum `bitcoin::script_type`
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "txid": "2bb85f4b004be6da54f766c17c1e855187327112c231ef2ff35ebad0ea67c69e",
+     *   "index": 0,
+     *   "scriptpubkey": "3b8b3ab1453eb47e2d4903b963776680e30863df3625d3e74292338ae7928da1",
+     *   "value": 1797928002,
+     *   "type": "vout",
+     *   "script_type": 5
+     * }
+     * ```
+     */
+    struct pending_utxo {
+        checksum256 txid;
+        uint32_t index;
+        std::vector<uint8_t> scriptpubkey;
+        uint64_t value;
+        name type;  // vin/vout/spent
+        uint8_t script_type;
+    };
+
+    /**
+     * ## TABLE `pendingpages`
+     *
+     * > Append-only log of the pending utxos of a parsed block, in parsing order, `PENDING_PAGE_SIZE` per page.
+     *
+     * ### scope `bucket_id`
+     * ### params
+     *
+     * - `{uint64_t} page` - primary key, the parse range in the upper 32 bits and the page of the range in the lower
+     * 32 bits
+     * - `{uint32_t} migrated` - number of utxos of the page that have been migrated
+     * - `{std::vector<pending_utxo>} utxos` - pending utxos @see struct `pending_utxo`
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "page": 0,
+     *   "migrated": 0,
+     *   "utxos": [{
+     *       "txid": "2bb85f4b004be6da54f766c17c1e855187327112c231ef2ff35ebad0ea67c69e",
+     *       "index": 0,
+     *       "scriptpubkey": "3b8b3ab1453eb47e2d4903b963776680e30863df3625d3e74292338ae7928da1",
+     *       "value": 1797928002,
+     *       "type": "vout",
+     *       "script_type": 5
+     *   }]
+     * }
+     * ```
+     */
+    struct [[eosio::table]] pending_page_row {
+        uint64_t page;
+        uint32_t migrated = 0;
+        std::vector<pending_utxo> utxos;
+        uint64_t primary_key() const { return page; }
+    };
+    typedef eosio::multi_index<"pendingpages"_n, pending_page_row> pending_page_table;
+
+    /**
+     * ## TABLE `pendingindex`
+     *
+     * > Outpoint lookup into `pendingpages`, only maintained when `index_pending_utxos` is enabled. Outpoints whose
+     * key collides with an indexed one are not indexed.
+     *
+     * ### scope `bucket_id`
+     * ### params
+     *
+     * - `{uint64_t} id` - primary key, the leading 8 bytes of the outpoint digest
+     * - `{uint64_t} page` - page of the pending utxo
+     * - `{uint32_t} slot` - position of the pending utxo in the page
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "id": 3104973555729820490,
+     *   "page": 0,
+     *   "slot": 0
+     * }
+     * ```
+     */
+    struct [[eosio::table]] pending_index_row {
+        uint64_t id;
+        uint64_t page;
+        uint32_t slot;
+        uint64_t primary_key() const { return id; }
+    };
+    typedef eosio::multi_index<"pendingindex"_n, pending_index_row> pending_index_table;
+
+    /**
+     * ## TABLE `parseranges`
+     *
+     * > Transaction ranges of a block that are parsed in parallel, one per verification round of the block @see
+     * TABLE `txoffsets` of blksync.xsat. Blocks verified in a single round are parsed by the block parser alone.
+     *
+     * ### scope `bucket_id`
+     * ### params
+     *
+     * - `{uint64_t} id` - primary key, the ranges are migrated in id order
+     * - `{uint64_t} from_transaction` - index of the first transaction of the range
+     * - `{parsing_progress_row} progress` - parsing progress of the range, `num_transactions` is the size of the
+     * range @see `parsing_progress_row`
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "id": 1,
+     *   "from_transaction": 2048,
+     *   "progress": {
+     *       "bucket_id": 11,
+     *       "num_utxos": 1024,
+     *       "num_transactions": 2048,
+     *       "parsed_transactions": 310,
+     *       "parsed_position": 689150,
+     *       "parsed_vin": 0,
+     *       "parsed_vout": 0,
+     *       "parser": "bob",
+     *       "parse_expiration_time": "2024-08-08T02:44:43"
+     *   }
+     * }
+     * ```
+     */
+    struct [[eosio::table]] parse_range_row {
+        uint64_t id;
+        uint64_t from_transaction;
+        parsing_progress_row progress;
+        uint64_t primary_key() const { return id; }
+    };
+    typedef eosio::multi_index<"parseranges"_n, parse_range_row> parse_range_table;
+
     /**
      * ## TABLE `spentutxos`
      *
@@ -407,19 +669,23 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
      *
      * - `{uint64_t} height` - block height
      * - `{uint64_t} bucket_id` - the associated bucket number is used to obtain block data
+     * - `{binary_extension<checksum256>} utxo_set_hash` - `chainstate.utxo_set_hash` after the block was migrated,
+     * the difference of two heights is the hash of the utxos added minus the utxos removed in between
      *
      * ### example
      *
      * ```json
      * {
      *   "height": 840001,
-     *   "bucket_id": 1
+     *   "bucket_id": 1,
+     *   "utxo_set_hash": "5a0e0cd5b1f4c1a2e1e6a1d8f3b7c0e9d2a4f6b8c0e2d4f6a8b0c2e4f6a8b0c2"
      * }
      * ```
      */
     struct [[eosio::table]] block_extra_row {
         uint64_t height;
         uint64_t bucket_id;
+        binary_extension<checksum256> utxo_set_hash;
         uint64_t primary_key() const { return height; }
     };
     typedef eosio::multi_index<"block.extra"_n, block_extra_row> block_extra_table;
@@ -447,6 +713,7 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
      * - `{bool} parse` - is it an parsed block
      * - `{bool} irreversible` - is it an irreversible block
      * - `{time_point_sec} created_at` - created at time
+     * - `{binary_extension<uint64_t>} branch_id` - the branch of the block @see TABLE `branches`
      *
      * ### example
      *
@@ -468,7 +735,8 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
      *   "num_utxos": 16278,
      *   "parse": 1,
      *   "irreversible": 1,
-     *   "created_at": "2024-08-13T00:00:00"
+     *   "created_at": "2024-08-13T00:00:00",
+     *   "branch_id": 3
      * }
      * ```
      */
@@ -490,6 +758,7 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
         bool irreversible;
         bool parse;
         time_point_sec created_at;
+        binary_extension<uint64_t> branch_id;
         uint64_t primary_key() const { return bucket_id; }
         uint64_t by_height() const { return height; }
         uint64_t by_synchronizer() const { return synchronizer.value; }
@@ -507,12 +776,96 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
                           const_mem_fun<consensus_block_row, checksum256, &consensus_block_row::by_block_id>>>
         consensus_block_table;
 
+    /**
+     * ## TABLE `branches`
+     *
+     * > Fork tree of the consensus blocks. A branch is a linear run of consensus blocks, a block that is not appended
+     * to the tip of the branch of its parent starts a new branch. Branches are erased once their tip is migrated.
+     *
+     * ### scope `get_self()`
+     * ### params
+     *
+     * - `{uint64_t} id` - primary key, bucket_id of the first block of the branch
+     * - `{uint64_t} parent_id` - branch of the parent of the first block, 0 if the parent is irreversible
+     * - `{uint64_t} start_height` - height of the first block
+     * - `{uint64_t} tip_height` - height of the tip
+     * - `{checksum256} tip_hash` - hash of the tip
+     * - `{checksum256} cumulative_work` - cumulative work of the tip
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "id": 3,
+     *   "parent_id": 0,
+     *   "start_height": 840003,
+     *   "tip_height": 840009,
+     *   "tip_hash": "00000000000000000000c6075e66b667adcdb8935e6d9a877f5cf140c806ae87",
+     *   "cumulative_work": "0000000000000000000000000000000000000000753d5d6dd2b6ee6d53f7a12b"
+     * }
+     * ```
+     */
+    struct [[eosio::table]] branch_row {
+        uint64_t id;
+        uint64_t parent_id;
+        uint64_t start_height;
+        uint64_t tip_height;
+        checksum256 tip_hash;
+        checksum256 cumulative_work;
+        uint64_t primary_key() const { return id; }
+        uint64_t by_tip_height() const { return tip_height; }
+        checksum256 by_cumulative_work() const { return cumulative_work; }
+    };
+    typedef eosio::multi_index<
+        "branches"_n, branch_row,
+        eosio::indexed_by<"bytipheight"_n, const_mem_fun<branch_row, uint64_t, &branch_row::by_tip_height>>,
+        eosio::indexed_by<"bywork"_n, const_mem_fun<branch_row, checksum256, &branch_row::by_cumulative_work>>>
+        branch_table;
+
+    /**
+     * ## TABLE `headerring`
+     *
+     * ### scope `get_self()`
+     * ### params
+     *
+     * - `{uint64_t} height` - block height, stored in the row `height % 4032`
+     * - `{checksum256} hash` - block hash
+     * - `{checksum256} previous_block_hash` - hash in internal byte order of the previous block’s header
+     * - `{checksum256} cumulative_work` - the cumulative workload of the block
+     * - `{uint32_t} timestamp` - the block time is a Unix epoch time
+     * - `{uint32_t} bits` - an encoded version of the target threshold this block’s header hash must be less than or equal to
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "height": 839999,
+     *   "hash": "0000000000000000000172014ba58d66455762add0512355ad651207918494ab",
+     *   "previous_block_hash": "00000000000000000001dcce6ce7c8a45872cafd1fb04732b447a14a91832591",
+     *   "cumulative_work": "0000000000000000000000000000000000000000753b8c1eaae701e1f0146360",
+     *   "timestamp": 1713571533,
+     *   "bits": 386089497
+     * }
+     * ```
+     */
+    struct [[eosio::table]] header_ring_row {
+        uint64_t height;
+        checksum256 hash;
+        checksum256 previous_block_hash;
+        checksum256 cumulative_work;
+        uint32_t timestamp;
+        uint32_t bits;
+        uint64_t primary_key() const { return height % HEADER_RING_SIZE; }
+    };
+    typedef eosio::multi_index<"headerring"_n, header_ring_row> header_ring_table;
+
     /**
      * ## STRUCT `process_block_result`
      *
      * ### params
      *
-     * - `{string} status` - current parsing status (waiting, migrating, deleting_data, distributing_rewards, parsing, parsing_completed)
+     * - `{string} status` - current parsing status (waiting, migrating, deleting_data, distributing_rewards, parsing, parsing_completed,
+     * waiting_ranges)
      * - `{uint64_t} height` - block height
      * - `{checksum256} block_hash` - block hash
      *
@@ -532,6 +885,116 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
         checksum256 block_hash;
     };
 
+    /**
+     * ## STRUCT `snapshot_utxo`
+     *
+     * > A utxo of a snapshot page, the scriptpubkey is kept in its compressed form.
+     *
+     * ### params
+     *
+     * - `{checksum256} txid` - transaction id
+     * - `{uint32_t} index` - vout index
+     * - `{uint8_t} script_type` - compression of the scriptpubkey @see enum `bitcoin::script_type`
+     * - `{vector<uint8_t>} scriptpubkey` - compressed script public key
+     * - `{uint64_t} value` - utxo quantity
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "txid": "a0db149ace545beabbd87a8d6b20ffd6aa3b5a50e58add49a3d435f898c272cf",
+     *   "index": 1,
+     *   "script_type": 1,
+     *   "scriptpubkey": "536ffa992491508dca0354e52f32a3a7a679a53a",
+     *   "value": 4075061499
+     * }
+     * ```
+     */
+    struct snapshot_utxo {
+        checksum256 txid;
+        uint32_t index;
+        uint8_t script_type;
+        std::vector<uint8_t> scriptpubkey;
+        uint64_t value;
+    };
+
+    /**
+     * ## STRUCT `export_utxos_result`
+     *
+     * ### params
+     *
+     * - `{uint64_t} height` - irreversible height of the exported set
+     * - `{checksum256} utxo_set_hash` - `chainstate.utxo_set_hash` of the exported set
+     * - `{vector<snapshot_utxo>} utxos` - utxos of the page @see `snapshot_utxo`
+     * - `{optional<uint64_t>} next_id` - `from_id` of the next page, empty after the last page
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "height": 840000,
+     *   "utxo_set_hash": "5a0e0cd5b1f4c1a2e1e6a1d8f3b7c0e9d2a4f6b8c0e2d4f6a8b0c2e4f6a8b0c2",
+     *   "utxos": [{
+     *       "txid": "a0db149ace545beabbd87a8d6b20ffd6aa3b5a50e58add49a3d435f898c272cf",
+     *       "index": 1,
+     *       "script_type": 1,
+     *       "scriptpubkey": "536ffa992491508dca0354e52f32a3a7a679a53a",
+     *       "value": 4075061499
+     *   }],
+     *   "next_id": 3104973555729820491
+     * }
+     * ```
+     */
+    struct export_utxos_result {
+        uint64_t height;
+        checksum256 utxo_set_hash;
+        std::vector<snapshot_utxo> utxos;
+        optional<uint64_t> next_id;
+    };
+
+    /**
+     * ## STRUCT `script_utxo`
+     *
+     * ### params
+     *
+     * - `{checksum256} txid` - transaction id
+     * - `{uint32_t} index` - vout index
+     * - `{uint64_t} value` - utxo quantity
+     */
+    struct script_utxo {
+        checksum256 txid;
+        uint32_t index;
+        uint64_t value;
+    };
+
+    /**
+     * ## STRUCT `get_utxos_result`
+     *
+     * > The utxos of a scriptpubkey, the scriptpubkey is not repeated per utxo.
+     *
+     * ### params
+     *
+     * - `{vector<script_utxo>} utxos` - utxos of the page @see `script_utxo`
+     * - `{optional<uint64_t>} cursor` - `cursor` of the next page, the id of its first utxo, empty after the last page
+     *
+     * ### example
+     *
+     * ```json
+     * {
+     *   "utxos": [{
+     *       "txid": "a0db149ace545beabbd87a8d6b20ffd6aa3b5a50e58add49a3d435f898c272cf",
+     *       "index": 1,
+     *       "value": 4075061499
+     *   }],
+     *   "cursor": 3104973555729820490
+     * }
+     * ```
+     */
+    struct get_utxos_result {
+        std::vector<script_utxo> utxos;
+        optional<uint64_t> cursor;
+    };
+
     /**
      * ## ACTION `init`
      *
@@ -583,6 +1046,50 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
                 const uint16_t retained_spent_utxo_blocks, const uint16_t num_retain_data_blocks,
                 const uint8_t num_merkle_layer, const uint16_t num_miner_priority_blocks);
 
+    /**
+     * ## ACTION `setbudget`
+     *
+     * - **authority**: `get_self()`
+     *
+     * > Set the weight budget of each verify and processblock round. The weight of a transaction is the number of
+     * bytes hashed plus the weighted number of inputs and outputs (see `WEIGHT_PER_*` in defines.hpp), a round stops
+     * before exceeding the budget and always processes at least one transaction (verify) or row (processblock).
+     *
+     * ### params
+     *
+     * - `{uint64_t} verification_budget` - weight budget of each verify round, 0 to use num_txs_per_verification
+     * - `{uint64_t} parse_budget` - weight budget of each processblock parsing round, 0 to use process_row only
+     *
+     * ### example
+     *
+     * ```bash
+     * $ cleos push action utxomng.xsat setbudget '[4000000, 1000000]' -p utxomng.xsat
+     * ```
+     */
+    [[eosio::action]]
+    void setbudget(const uint64_t verification_budget, const uint64_t parse_budget);
+
+    /**
+     * ## ACTION `setindexing`
+     *
+     * - **authority**: `get_self()`
+     *
+     * > Enable or disable the `pendingindex` outpoint lookup of pending utxos. When enabled, a vout spent by a later
+     * transaction of the same block is netted even if the two were parsed in different processblock rounds.
+     *
+     * ### params
+     *
+     * - `{bool} index_pending_utxos` - whether to maintain the `pendingindex` table while parsing
+     *
+     * ### example
+     *
+     * ```bash
+     * $ cleos push action utxomng.xsat setindexing '[true]' -p utxomng.xsat
+     * ```
+     */
+    [[eosio::action]]
+    void setindexing(const bool index_pending_utxos);
+
     /**
      * ## ACTION `addutxo`
      *
@@ -629,6 +1136,124 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
     [[eosio::action]]
     void delutxo(const uint64_t id);
 
+    /**
+     * ## ACTION `countutxos`
+     *
+     * - **authority**: `get_self()`
+     *
+     * > Backfill `balances` and `chainstate.utxo_set_hash` with a page of `utxos` saved before the upgrade, and set
+     * their `counted` flag. The rows are saved again to enter the index that `getutxos` pages through. Returns the
+     * first utxo id of the next page, empty after the last page.
+     *
+     * ### params
+     *
+     * - `{uint64_t} from_id` - first utxo id of the page, 0 for the first page
+     * - `{uint16_t} limit` - maximum number of utxos of the page
+     *
+     * ### example
+     *
+     * ```bash
+     * $ cleos push action utxomng.xsat countutxos '[0, 1000]' -p utxomng.xsat
+     * ```
+     */
+    [[eosio::action]]
+    optional<uint64_t> countutxos(const uint64_t from_id, const uint16_t limit);
+
+    /**
+     * ## ACTION `importutxos`
+     *
+     * - **authority**: `get_self()`
+     *
+     * > Import a page of a utxo snapshot taken at `START_HEIGHT`, e.g. the pages of `exportutxos`. The last page
+     * passes the committed set hash, the import is rejected unless `chainstate.utxo_set_hash` matches it. Each
+     * `script_type` must be a known template whose payload has the template's length.
+     *
+     * ### params
+     *
+     * - `{uint64_t} height` - height of the snapshot
+     * - `{vector<snapshot_utxo>} utxos` - utxos of the page @see `snapshot_utxo`
+     * - `{optional<checksum256>} utxo_set_hash` - committed set hash, only passed with the last page
+     *
+     * ### example
+     *
+     * ```bash
+     * $ cleos push action utxomng.xsat importutxos '[839999, [{"txid":
+     * "a0db149ace545beabbd87a8d6b20ffd6aa3b5a50e58add49a3d435f898c272cf", "index": 1, "script_type": 1,
+     * "scriptpubkey": "536ffa992491508dca0354e52f32a3a7a679a53a", "value": 4075061499}], null]' -p utxomng.xsat
+     * ```
+     */
+    [[eosio::action]]
+    void importutxos(const uint64_t height, const std::vector<snapshot_utxo> &utxos,
+                     const optional<checksum256> &utxo_set_hash);
+
+    /**
+     * ## ACTION `exportutxos`
+     *
+     * - **authority**: `anyone`
+     *
+     * > Read-only, returns a page of `utxos` in primary key order starting at `from_id`.
+     *
+     * ### params
+     *
+     * - `{uint64_t} from_id` - first utxo id of the page, 0 for the first page
+     * - `{uint16_t} limit` - maximum number of utxos of the page
+     *
+     * ### example
+     *
+     * ```bash
+     * $ cleos push action utxomng.xsat exportutxos '[0, 1000]' -p alice --read-only
+     * ```
+     */
+    [[eosio::action, eosio::read_only]]
+    export_utxos_result exportutxos(const uint64_t from_id, const uint16_t limit);
+
+    /**
+     * ## ACTION `getutxo`
+     *
+     * - **authority**: `anyone`
+     *
+     * > Read-only, returns the unspent output, empty if it does not exist or has been spent.
+     *
+     * ### params
+     *
+     * - `{checksum256} txid` - transaction id
+     * - `{uint32_t} index` - vout index
+     *
+     * ### example
+     *
+     * ```bash
+     * $ cleos push action utxomng.xsat getutxo '["a0db149ace545beabbd87a8d6b20ffd6aa3b5a50e58add49a3d435f898c272cf", 1]'
+     * -p alice --read-only
+     * ```
+     */
+    [[eosio::action, eosio::read_only]]
+    optional<snapshot_utxo> getutxo(const checksum256 &txid, const uint32_t index);
+
+    /**
+     * ## ACTION `getutxos`
+     *
+     * - **authority**: `anyone`
+     *
+     * > Read-only, returns a page of the utxos of the scriptpubkey in id order. A page is sought directly by the
+     * scriptpubkey and `cursor`, and resumes after `cursor` even when its utxo has been spent in between. Utxos saved
+     * before the upgrade are listed once `countutxos` has backfilled them.
+     *
+     * ### params
+     *
+     * - `{vector<uint8_t>} scriptpubkey` - script public key
+     * - `{uint64_t} cursor` - `cursor` returned with the previous page, 0 for the first page
+     * - `{uint16_t} limit` - maximum number of utxos of the page
+     *
+     * ### example
+     *
+     * ```bash
+     * $ cleos push action utxomng.xsat getutxos '["76a914536ffa992491508dca0354e52f32a3a7a679a53a88ac", 0, 100]'
+     * -p alice --read-only
+     * ```
+     */
+    [[eosio::action, eosio::read_only]]
+    get_utxos_result getutxos(const vector<uint8_t> &scriptpubkey, const uint64_t cursor, const uint16_t limit);
+
     /**
      * ## ACTION `addblock`
      *
@@ -726,12 +1351,17 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
      *
      * - **authority**: `synchronizer`
      *
-     * > Parse utxo
+     * > Parse utxo and migrate the irreversible block. Parsing and migration are independent lanes: the parser of
+     * the current block parses it, other synchronizers migrate, delete the data of and distribute the rewards of the
+     * irreversible block meanwhile. The parser migrates when parsing is more than `MAX_PARSE_LEAD_BLOCKS` ahead of
+     * the migrating block. A block verified in several rounds is split into `parseranges`, other synchronizers can
+     * parse the ranges that are not held by anyone while the block is being parsed. Once the remaining ranges are all
+     * held by others, the parser migrates meanwhile, or gets `waiting_ranges` when there is nothing to migrate.
      *
      * ### params
      *
      * - `{name} synchronizer` - synchronizer account
-     * - `{uint64_t} process_rows` - number of vins and vouts to be parsed
+     * - `{uint64_t} process_rows` - number of vins and vouts to be parsed, or rows to be migrated or deleted
      * - `{uint64_t} none` - unique value for each call to prevent duplicate transactions 
      *
      * ### example
@@ -795,6 +1425,14 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
                       const uint32_t bits, const uint32_t nonce, const name &synchronizer, const name &miner,
                       const time_point_sec &created_at);
 
+    [[eosio::action]]
+    void addspentutxo(const uint64_t id, const uint64_t height, const checksum256 &txid, const uint32_t index,
+                      const vector<uint8_t> &scriptpubkey, const uint64_t value);
+
+    [[eosio::action]]
+    void addlegacyutxo(const uint64_t id, const checksum256 &txid, const uint32_t index,
+                       const vector<uint8_t> &scriptpubkey, const uint64_t value);
+
     void resetpending(uint64_t row);
 #endif
 
@@ -840,6 +1478,39 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
         return eosio::sha256((char *)result.data(), result.size());
     }
 
+    // primary key of a utxo row, the leading 8 bytes of `xsat::utils::compute_utxo_id`
+    static uint64_t compute_utxo_key(const checksum256 &utxo_id) {
+        const auto bytes = utxo_id.extract_as_byte_array();
+        uint64_t key = 0;
+        for (int i = 0; i < 8; i++) {
+            key = (key << 8) | bytes[i];
+        }
+        return key;
+    }
+
+    // key of the `byscriptid` index of utxos, the leading 24 bytes of the scriptpubkey hash followed by the big-endian
+    // id, so the utxos of a scriptpubkey are ordered by id and a page can be sought from any id
+    static checksum256 compute_script_id(const checksum256 &scripthash, const uint64_t id) {
+        auto bytes = scripthash.extract_as_byte_array();
+        for (int i = 0; i < 8; i++) {
+            bytes[31 - i] = (id >> (8 * i)) & 0xff;
+        }
+        return checksum256(bytes);
+    }
+
+    // element of `chainstate.utxo_set_hash`, computed on the decompressed scriptpubkey
+    static checksum256 compute_utxo_hash(const utxo_row &utxo) {
+        const auto scriptpubkey = utxo.get_scriptpubkey();
+        std::vector<char> result;
+        result.resize(44 + eosio::pack_size(scriptpubkey));
+        eosio::datastream<char *> ds(result.data(), result.size());
+        ds << utxo.txid;
+        ds << utxo.index;
+        ds << utxo.value;
+        ds << scriptpubkey;
+        return eosio::sha256((char *)result.data(), result.size());
+    }
+
     static uint128_t compute_parse_height(const bool parse, const uint64_t height) {
         return uint128_t(parse) << 64 | height;
     }
@@ -857,6 +1528,19 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
     }
 
     static optional<bitcoin::core::block> get_ancestor(const uint64_t height, const optional<checksum256> hash) {
+        // recent blocks are served by a single primary key lookup
+        utxo_manage::header_ring_table _header_ring(UTXO_MANAGE_CONTRACT, UTXO_MANAGE_CONTRACT.value);
+        auto header_ring_itr = _header_ring.find(height % HEADER_RING_SIZE);
+        if (header_ring_itr != _header_ring.end() && header_ring_itr->height == height
+            && (!hash.has_value() || header_ring_itr->hash == *hash)) {
+            return bitcoin::core::block{.height = height,
+                                        .hash = header_ring_itr->hash,
+                                        .previous_block_hash = header_ring_itr->previous_block_hash,
+                                        .cumulative_work = header_ring_itr->cumulative_work,
+                                        .timestamp = header_ring_itr->timestamp,
+                                        .bits = header_ring_itr->bits};
+        }
+
         utxo_manage::consensus_block_table _consensus_block(UTXO_MANAGE_CONTRACT, UTXO_MANAGE_CONTRACT.value);
         optional<bitcoin::core::block> result = std::nullopt;
         if (hash.has_value()) {
@@ -914,14 +1598,46 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
     chain_state_table _chain_state = chain_state_table(_self, _self.value);
     block_extra_table _block_extra = block_extra_table(_self, _self.value);
     utxo_table _utxo = utxo_table(_self, _self.value);
+    balance_table _balance = balance_table(_self, _self.value);
     pending_utxo_table _pending_utxo = pending_utxo_table(_self, _self.value);
     spent_utxo_table _spent_utxo = spent_utxo_table(_self, _self.value);
     block_table _block = block_table(_self, _self.value);
     consensus_block_table _consensus_block = consensus_block_table(_self, _self.value);
+    block_parsing_table _block_parsing = block_parsing_table(_self, _self.value);
+    header_ring_table _header_ring = header_ring_table(_self, _self.value);
+    branch_table _branch = branch_table(_self, _self.value);
 
     // private function
-    void parsing_transactions(const uint64_t height, const checksum256 &hash, parsing_progress_row *parsing_progress,
-                              uint64_t process_row);
+    // range: the parse range the pending utxos are appended to, 0 when the block is not split
+    void parsing_transactions(const uint64_t height, const checksum256 &hash, const uint64_t range,
+                              parsing_progress_row *parsing_progress, uint64_t process_row, const uint64_t budget,
+                              const bool index_pending_utxos);
+
+    // splits the block at the verification rounds, returns false if it was verified in a single round
+    bool init_parse_ranges(parsing_progress_row &parsing_progress);
+
+    // the range held by the synchronizer, otherwise the first unclaimed or expired one
+    parse_range_table::const_iterator find_parse_range(parse_range_table &_parse_range, const name &synchronizer,
+                                                       const time_point &current_time);
+
+    void parse_range(const uint64_t height, const checksum256 &hash, const name &synchronizer,
+                     parsing_progress_row *parsing_progress, uint64_t process_row, const config_row &config);
+
+    // migration lane: migrate, delete data and distribute rewards of the irreversible block
+    void process_migration(chain_state_row &chain_state, const config_row &config, uint64_t process_row);
+
+    // parsing lane, returns true when the block has been completely parsed
+    bool process_parsing(chain_state_row &chain_state, block_parsing_table::const_iterator block_parsing_itr,
+                         parsing_progress_row &parsing_progress, const name &synchronizer, uint64_t process_row,
+                         const config_row &config);
+
+    void set_parsing_progress(const checksum256 &hash, const parsing_progress_row &parsing_progress);
+
+    // moves the progress left in the legacy `chainstate.parsing_progress_of` to `parsingprogs` and initializes the
+    // extensions of `chainstate`, called before the chain state is updated
+    void upgrade_chain_state(chain_state_row &chain_state);
+
+    void migrate_pending_utxo(chain_state_row &chain_state, const pending_utxo &utxo);
 
     void migrate(chain_state_row &chain_state, uint64_t process_row);
 
@@ -935,17 +1651,41 @@ class [[eosio::contract("utxomng.xsat")]] utxo_manage : public contract {
 
     void find_set_next_irreversible_block(chain_state_row &chain_state);
 
-    void save_spent_utxo(const uint64_t height, const utxo_manage::utxo_row &pending_utxo);
+    // appends the block to the branch of its parent or starts a new branch, returns the branch id
+    uint64_t save_branch(const uint64_t bucket_id, const uint64_t height, const checksum256 &hash,
+                         const checksum256 &previous_block_hash, const checksum256 &cumulative_work);
+
+    // overwrite: replace a different block of the same height
+    void save_header(const bitcoin::core::block &block, const bool overwrite);
+
+    // saved at the migrating height, the id is allocated from chain_state and persisted with it
+    void save_spent_utxo(chain_state_row &chain_state, const utxo_manage::utxo_row &utxo);
+
+    // appends to the last page of the range, indexes the appended utxos when index_pending_utxos is enabled
+    void save_pending_utxos(const uint64_t bucket_id, const uint64_t range,
+                            const std::vector<pending_utxo> &pending_utxos, const bool index_pending_utxos);
+
+    // marks an indexed vout of the bucket as spent, returns false if it is not indexed
+    bool spend_pending_vout(const uint64_t bucket_id, const checksum256 &txid, const uint32_t index);
+
+    // also erases the parse ranges, returns whether rows of the bucket are left after the batch
+    bool erase_pending_utxos(const uint64_t bucket_id, uint64_t &process_row);
+
+    // looks up the primary key first, falls back to `byutxoid`
+    utxo_table::const_iterator find_utxo(const checksum256 &txid, const uint32_t index);
+
+    optional<utxo_row> remove_utxo(chain_state_row &chain_state, const checksum256 &prev_txid,
+                                   const uint32_t prev_index);
 
-    void save_pending_utxo(const uint64_t height, const checksum256 &hash, const checksum256 &txid,
-                           const uint32_t index, const std::vector<uint8_t> &script_data, const uint64_t value,
-                           const name &type);
+    // script_data is compressed with script_type, @see enum `bitcoin::script_type`
+    utxo_row save_utxo(chain_state_row &chain_state, const checksum256 &txid, const uint32_t index,
+                       const uint8_t script_type, const std::vector<uint8_t> &script_data, const uint64_t value);
 
-    template <typename IDX>
-    optional<utxo_row> remove_utxo(IDX &utxo_idx, const checksum256 &prev_txid, const uint32_t prev_index);
+    // adds the utxo to `chainstate.utxo_set_hash`, or subtracts it when removed unless it was never counted
+    void update_utxo_set_hash(chain_state_row &chain_state, const utxo_row &utxo, const bool removed);
 
-    utxo_row save_utxo(const checksum256 &txid, const uint32_t index, const std::vector<uint8_t> &script_data,
-                       const uint64_t value);
+    // adds the utxo to the `balances` row of its scriptpubkey, or subtracts it when removed
+    void update_balance(const chain_state_row &chain_state, const utxo_row &utxo, const bool removed);
 
 #ifdef DEBUG
     template <typename T>
@@ -11,21 +11,23 @@
 
 namespace bitcoin::core {
 
-    bitcoin::uint256_t generate_header_merkle(const std::vector<bitcoin::core::transaction>& transactions,
-                                              bool* mutated) {
+    // Transaction is bitcoin::core::transaction or bitcoin::core::transaction_view
+    template <typename Transaction>
+    bitcoin::uint256_t generate_header_merkle(const std::vector<Transaction>& transactions, bool* mutated) {
         auto transaction_hashes = std::vector<bitcoin::uint256_t>();
         transaction_hashes.reserve(transactions.size());
+        // scratch space shared by the witness transactions
+        std::vector<char> buffer;
         for (const auto& transaction : transactions) {
-            auto hash = transaction.merkle_hash();
+            auto hash = transaction.merkle_hash(buffer);
             transaction_hashes.emplace_back(std::move(hash));
         }
 
         return bitcoin::generate_merkle_root(transaction_hashes, mutated);
     }
 
-    bitcoin::uint256_t generate_witness_merkle(std::vector<eosio::checksum256>& hashes,
-                                               const eosio::checksum256& witness_reserved_value) {
-        bitcoin::uint256_t witness_merkle = generate_merkle_root(hashes);
+    bitcoin::uint256_t generate_witness_commitment(const bitcoin::uint256_t& witness_merkle,
+                                                   const eosio::checksum256& witness_reserved_value) {
         auto concatenated_hashes = std::array<uint8_t, 64>();
         auto ds = eosio::datastream<uint8_t*>(concatenated_hashes.data(), concatenated_hashes.size());
         ds << witness_merkle << witness_reserved_value;
@@ -33,8 +35,8 @@ namespace bitcoin::core {
         return bitcoin::dhash(concatenated_hashes);
     }
 
-    bitcoin::uint256_t generate_witness_merkle(const std::vector<bitcoin::core::transaction>& transactions,
-                                               bool* mutated) {
+    template <typename Transaction>
+    bitcoin::uint256_t generate_witness_merkle(const std::vector<Transaction>& transactions, bool* mutated) {
         auto transaction_hashes = std::vector<bitcoin::uint256_t>();
         transaction_hashes.reserve(transactions.size());
 
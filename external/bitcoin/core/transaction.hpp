@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <vector>
 #include <optional>
@@ -38,6 +39,22 @@ namespace bitcoin::core {
         // see below for serialization
     };
 
+    // txid of the serialized transaction [tx, tx + size), hashed straight from the raw bytes.
+    // For witness transactions only the version, inputs, outputs and locktime ranges are hashed,
+    // witness_offset is the offset of the witness data and buffer is reused scratch space.
+    inline uint256_t compute_txid(const char* tx, const size_t size, const bool has_witness, const size_t witness_offset,
+                                  std::vector<char>& buffer) {
+        if (!has_witness) {
+            return bitcoin::dhash(tx, size);
+        }
+        // skip the 2 bytes of witness marker and flag after the version
+        buffer.clear();
+        buffer.insert(buffer.end(), tx, tx + 4);
+        buffer.insert(buffer.end(), tx + 6, tx + witness_offset);
+        buffer.insert(buffer.end(), tx + size - 4, tx + size);
+        return bitcoin::dhash(buffer);
+    }
+
     struct transaction {
         uint32_t version;
         std::vector<transaction_input> inputs;
@@ -48,6 +65,8 @@ namespace bitcoin::core {
         std::vector<char>* data;
         uint32_t from;
         uint32_t to;
+        // offset of the witness data in data (locktime if there is no witness)
+        uint32_t witness_offset;
         //If Witness is not used, it can be set to false to speed up deserialization
         bool allow_witness;
 
@@ -68,15 +87,22 @@ namespace bitcoin::core {
             ds << locktime;
         }
 
-        uint256_t merkle_hash() const {
+        // hashes the raw ranges in data, set data to nullptr after modifying a deserialized transaction
+        uint256_t merkle_hash(std::vector<char>& buffer) const {
+            if (data != nullptr) {
+                return compute_txid(data->data() + from, to - from, !witness.empty(), witness_offset - from, buffer);
+            }
             eosio::datastream<size_t> ps;
             serialize_for_merkle(ps);
-            auto serialized_size = ps.tellp();
-            std::vector<char> hash_data;
-            hash_data.resize(serialized_size);
-            eosio::datastream<char*> ds(hash_data.data(), hash_data.size());
+            buffer.resize(ps.tellp());
+            eosio::datastream<char*> ds(buffer.data(), buffer.size());
             serialize_for_merkle(ds);
-            return bitcoin::dhash(hash_data);
+            return bitcoin::dhash(buffer);
+        }
+
+        uint256_t merkle_hash() const {
+            std::vector<char> buffer;
+            return merkle_hash(buffer);
         }
 
         uint256_t hash() const {
@@ -136,6 +162,186 @@ namespace bitcoin::core {
 
         // see below for serialization
     };
+
+    struct script_view {
+        const uint8_t* data;
+        size_t size;
+
+        std::vector<uint8_t> to_vector() const { return std::vector<uint8_t>(data, data + size); }
+    };
+
+    struct input_view {
+        bitcoin::uint256_t previous_output_hash;
+        uint32_t previous_output_index;
+        script_view script_sig;
+        uint32_t sequence;
+    };
+
+    struct output_view {
+        uint64_t value;
+        script_view script;
+    };
+
+    // Records the layout of a transaction inside the raw block buffer.
+    // Inputs, outputs and scripts are read on demand as views into the buffer, nothing is copied.
+    struct transaction_view {
+        uint32_t version;
+        uint32_t locktime;
+        bool has_witness;
+        uint64_t num_inputs;
+        uint64_t num_outputs;
+        // Location of auxiliary data recording tx
+        const std::vector<char>* data;
+        uint32_t from;
+        uint32_t to;
+        // offset of the first input, the first output and the witness data (locktime if there is no witness)
+        uint32_t inputs_offset;
+        uint32_t outputs_offset;
+        uint32_t witness_offset;
+
+        transaction_view(const std::vector<char>* data) : data(data) {}
+
+        // reads the input at offset, returns the offset of the next input
+        uint32_t read_input(const uint32_t offset, input_view& input) const {
+            eosio::datastream<const char*> ds(data->data() + offset, to - offset);
+            ds >> input.previous_output_hash;
+            ds >> input.previous_output_index;
+            input.script_sig.size = bitcoin::varint::decode(ds);
+            input.script_sig.data = reinterpret_cast<const uint8_t*>(ds.pos());
+            ds.skip(input.script_sig.size);
+            ds >> input.sequence;
+            return offset + ds.tellp();
+        }
+
+        // reads the output at offset, returns the offset of the next output
+        uint32_t read_output(const uint32_t offset, output_view& output) const {
+            eosio::datastream<const char*> ds(data->data() + offset, to - offset);
+            ds >> output.value;
+            output.script.size = bitcoin::varint::decode(ds);
+            output.script.data = reinterpret_cast<const uint8_t*>(ds.pos());
+            ds.skip(output.script.size);
+            return offset + ds.tellp();
+        }
+
+        uint32_t input_offset(const uint64_t index) const {
+            auto offset = inputs_offset;
+            input_view input;
+            for (uint64_t i = 0; i < index; i++) {
+                offset = read_input(offset, input);
+            }
+            return offset;
+        }
+
+        uint32_t output_offset(const uint64_t index) const {
+            auto offset = outputs_offset;
+            output_view output;
+            for (uint64_t i = 0; i < index; i++) {
+                offset = read_output(offset, output);
+            }
+            return offset;
+        }
+
+        uint256_t merkle_hash(std::vector<char>& buffer) const {
+            return compute_txid(data->data() + from, to - from, has_witness, witness_offset - from, buffer);
+        }
+
+        uint256_t merkle_hash() const {
+            std::vector<char> buffer;
+            return merkle_hash(buffer);
+        }
+
+        uint256_t hash() const {
+            const size_t len = to - from;
+            return bitcoin::dhash(data->data() + from, len);
+        }
+
+        bool is_coinbase() const {
+            if (num_inputs != 1) {
+                return false;
+            }
+            const auto* previous_output_hash = data->data() + inputs_offset;
+            return std::all_of(previous_output_hash, previous_output_hash + 32, [](char c) { return c == 0; });
+        }
+
+        // see below for serialization
+    };
+
+    // Serialized size of the transaction at the beginning of [data, data + size).
+    // Returns std::nullopt if the buffer ends before the transaction does.
+    inline std::optional<size_t> transaction_size(const char* data, const size_t size) {
+        size_t pos = 0;
+        bool incomplete = false;
+
+        auto skip = [&](uint64_t len) {
+            if (incomplete || len > size - pos) {
+                incomplete = true;
+            } else {
+                pos += len;
+            }
+        };
+        auto read_varint = [&]() -> uint64_t {
+            if (incomplete || pos >= size) {
+                incomplete = true;
+                return 0;
+            }
+            const uint8_t length_code = data[pos++];
+            if (length_code < 0xFD) {
+                return length_code;
+            }
+            const size_t len = length_code == 0xFD ? 2 : length_code == 0xFE ? 4 : 8;
+            if (len > size - pos) {
+                incomplete = true;
+                return 0;
+            }
+            uint64_t result = 0;
+            for (size_t i = 0; i < len; i++) {
+                result |= static_cast<uint64_t>(static_cast<uint8_t>(data[pos + i])) << (8 * i);
+            }
+            pos += len;
+            return result;
+        };
+
+        // version
+        skip(4);
+        if (incomplete || size - pos < 2) {
+            return std::nullopt;
+        }
+        const bool has_witness = data[pos] == 0x00 && data[pos + 1] == 0x01;
+        if (has_witness) {
+            skip(2);
+        }
+
+        const auto input_count = read_varint();
+        for (uint64_t i = 0; i < input_count && !incomplete; i++) {
+            // previous output (36), script_sig, sequence (4)
+            skip(36);
+            skip(read_varint());
+            skip(4);
+        }
+
+        const auto output_count = read_varint();
+        for (uint64_t i = 0; i < output_count && !incomplete; i++) {
+            // value (8), script
+            skip(8);
+            skip(read_varint());
+        }
+
+        if (has_witness) {
+            for (uint64_t i = 0; i < input_count && !incomplete; i++) {
+                const auto stack_length = read_varint();
+                for (uint64_t j = 0; j < stack_length && !incomplete; j++) {
+                    skip(read_varint());
+                }
+            }
+        }
+
+        // locktime
+        skip(4);
+        if (incomplete) {
+            return std::nullopt;
+        }
+        return pos;
+    }
 };  // namespace bitcoin::core
 
 namespace eosio {
@@ -209,6 +415,7 @@ namespace eosio {
             v.outputs.push_back(output);
         }
 
+        v.witness_offset = ds.tellp();
         if (has_witness == 0x0100) {
             if (v.allow_witness) {
                 v.witness.reserve(input_count);
@@ -234,6 +441,56 @@ namespace eosio {
         return ds;
     }
 
+    /**
+ *  Deserialize a transaction view, only the layout of the transaction is recorded
+ *
+ *  @param ds - The stream to read
+ *  @param v - The destination for deserialized value
+ *  @tparam Stream - Type of datastream buffer
+ *  @return datastream<Stream>& - Reference to the datastream
+ */
+    template <typename Stream>
+    datastream<Stream>& operator>>(datastream<Stream>& ds, bitcoin::core::transaction_view& v) {
+        v.from = ds.tellp();
+        ds >> v.version;
+        auto rewind = ds.tellp();
+        uint16_t has_witness;
+        ds >> has_witness;
+        v.has_witness = has_witness == 0x0100;
+        if (!v.has_witness) {
+            ds.seekp(rewind);
+        }
+
+        v.num_inputs = bitcoin::varint::decode(ds);
+        v.inputs_offset = ds.tellp();
+        for (uint64_t i = 0; i < v.num_inputs; i++) {
+            ds.skip(36);
+            ds.skip(bitcoin::varint::decode(ds));
+            ds.skip(4);
+        }
+
+        v.num_outputs = bitcoin::varint::decode(ds);
+        v.outputs_offset = ds.tellp();
+        for (uint64_t i = 0; i < v.num_outputs; i++) {
+            ds.skip(8);
+            ds.skip(bitcoin::varint::decode(ds));
+        }
+
+        v.witness_offset = ds.tellp();
+        if (v.has_witness) {
+            for (uint64_t i = 0; i < v.num_inputs; i++) {
+                auto length = bitcoin::varint::decode(ds);
+                for (uint64_t j = 0; j < length; j++) {
+                    ds.skip(bitcoin::varint::decode(ds));
+                }
+            }
+        }
+
+        ds >> v.locktime;
+        v.to = ds.tellp();
+        return ds;
+    }
+
     /**
  *  Serialize a witness
  *
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <bitcoin/script/script.hpp>
+#include <vector>
+
+namespace bitcoin {
+
+    /**
+     * Templates of the compressed scriptPubKey, similar to Bitcoin Core's ScriptCompression. A compressed script is
+     * stored as its template plus the hash or key payload, any other script is stored as raw bytes.
+     */
+    enum script_type : uint8_t {
+        SCRIPT_RAW = 0,     // raw script bytes
+        SCRIPT_P2PKH = 1,   // OP_DUP OP_HASH160 <20> OP_EQUALVERIFY OP_CHECKSIG
+        SCRIPT_P2SH = 2,    // OP_HASH160 <20> OP_EQUAL
+        SCRIPT_P2WPKH = 3,  // OP_0 <20>
+        SCRIPT_P2WSH = 4,   // OP_0 <32>
+        SCRIPT_P2TR = 5,    // OP_1 <32>
+    };
+
+    // returns the template of the script and writes the bytes to be stored to `out`
+    static uint8_t compress_script(const std::vector<unsigned char>& script, std::vector<unsigned char>& out) {
+        const auto size = script.size();
+        if (size == 25 && script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == 20
+            && script[23] == OP_EQUALVERIFY && script[24] == OP_CHECKSIG) {
+            out.assign(script.begin() + 3, script.begin() + 23);
+            return SCRIPT_P2PKH;
+        }
+        if (size == 23 && script[0] == OP_HASH160 && script[1] == 20 && script[22] == OP_EQUAL) {
+            out.assign(script.begin() + 2, script.begin() + 22);
+            return SCRIPT_P2SH;
+        }
+        if (size == 22 && script[0] == OP_0 && script[1] == 20) {
+            out.assign(script.begin() + 2, script.end());
+            return SCRIPT_P2WPKH;
+        }
+        if (size == 34 && script[0] == OP_0 && script[1] == 32) {
+            out.assign(script.begin() + 2, script.end());
+            return SCRIPT_P2WSH;
+        }
+        if (size == 34 && script[0] == OP_1 && script[1] == 32) {
+            out.assign(script.begin() + 2, script.end());
+            return SCRIPT_P2TR;
+        }
+        out = script;
+        return SCRIPT_RAW;
+    }
+
+    // whether `data` is a valid stored payload of the template `type`, raw scripts are accepted as is
+    static bool is_script_payload(const uint8_t type, const std::vector<unsigned char>& data) {
+        switch (type) {
+            case SCRIPT_RAW:
+                return true;
+            case SCRIPT_P2PKH:
+            case SCRIPT_P2SH:
+            case SCRIPT_P2WPKH:
+                return data.size() == 20;
+            case SCRIPT_P2WSH:
+            case SCRIPT_P2TR:
+                return data.size() == 32;
+            default:
+                return false;
+        }
+    }
+
+    static std::vector<unsigned char> decompress_script(const uint8_t type, const std::vector<unsigned char>& data) {
+        std::vector<unsigned char> script;
+        switch (type) {
+            case SCRIPT_P2PKH:
+                script.reserve(25);
+                script.push_back(OP_DUP);
+                script.push_back(OP_HASH160);
+                script.push_back(20);
+                script.insert(script.end(), data.begin(), data.end());
+                script.push_back(OP_EQUALVERIFY);
+                script.push_back(OP_CHECKSIG);
+                return script;
+            case SCRIPT_P2SH:
+                script.reserve(23);
+                script.push_back(OP_HASH160);
+                script.push_back(20);
+                script.insert(script.end(), data.begin(), data.end());
+                script.push_back(OP_EQUAL);
+                return script;
+            case SCRIPT_P2WPKH:
+            case SCRIPT_P2WSH:
+            case SCRIPT_P2TR:
+                script.reserve(data.size() + 2);
+                script.push_back(type == SCRIPT_P2TR ? OP_1 : OP_0);
+                script.push_back(static_cast<unsigned char>(data.size()));
+                script.insert(script.end(), data.begin(), data.end());
+                return script;
+            default:
+                return data;
+        }
+    }
+
+}  // namespace bitcoin
@@ -82,4 +82,61 @@ namespace bitcoin {
         return generate_merkle_root(data, mutated);
     }
 
+    bitcoin::uint256_t merkle_hash_pair(const bitcoin::uint256_t& left, const bitcoin::uint256_t& right) {
+        auto concatenated_hashes = std::array<uint8_t, 64>();
+        auto ds = eosio::datastream<uint8_t*>(concatenated_hashes.data(), concatenated_hashes.size());
+        ds << left << right;
+        return bitcoin::dhash(concatenated_hashes);
+    }
+
+    // Streaming merkle root computation. roots holds the pending subtree root for every set bit of count,
+    // from the highest level to the lowest, so leaves can be appended in batches of any size and the state
+    // never exceeds 64 hashes. root() gives the same result as generate_merkle_root over all the leaves.
+    struct merkle_frontier {
+        uint64_t count = 0;
+        std::vector<bitcoin::uint256_t> roots;
+        // two identical siblings were combined (CVE-2012-2459)
+        bool mutated = false;
+
+        void append(bitcoin::uint256_t hash) {
+            count++;
+            // every trailing zero bit of count closes a subtree
+            for (auto n = count; (n & 1) == 0; n >>= 1) {
+                mutated |= roots.back() == hash;
+                hash = merkle_hash_pair(roots.back(), hash);
+                roots.pop_back();
+            }
+            roots.push_back(hash);
+        }
+
+        bitcoin::uint256_t root(bool* mutation = nullptr) const {
+            bool is_mutated = mutated;
+            bitcoin::uint256_t hash = 0;
+            if (count > 0) {
+                auto n = count;
+                auto index = roots.size() - 1;
+                uint32_t level = 0;
+                while ((n & (uint64_t(1) << level)) == 0) {
+                    level++;
+                }
+                hash = roots[index];
+                while (n != (uint64_t(1) << level)) {
+                    // odd number of nodes at this level, duplicate the last one
+                    hash = merkle_hash_pair(hash, hash);
+                    n += uint64_t(1) << level;
+                    level++;
+                    // and combine with the pending roots it now completes
+                    while ((n & (uint64_t(1) << level)) == 0) {
+                        index--;
+                        is_mutated |= roots[index] == hash;
+                        hash = merkle_hash_pair(roots[index], hash);
+                        level++;
+                    }
+                }
+            }
+            if (mutation) *mutation = is_mutated;
+            return hash;
+        }
+    };
+
 }  // namespace bitcoin
\ No newline at end of file
@@ -3,6 +3,7 @@ const { Blockchain, log, expectToThrow } = require('@proton/vert')
 const { BTC, BTC_CONTRACT } = require('./src/constants')
 const fs = require('fs')
 const path = require('path')
+const crypto = require('crypto')
 
 const { decodeReturn_verify, max_chunk_size, addTime } = require('./src/help')
 
@@ -41,10 +42,38 @@ const get_consensus_block = bucket_id => {
     }
 }
 
+const get_branches = () => {
+    return contracts.utxomng.tables.branches().getTableRows()
+}
+
 const get_block_chunks = chunk_id => {
     return contracts.blksync.tables['block.chunk'](BigInt(chunk_id)).getTableRows()
 }
 
+const get_chunk_data = () => {
+    return contracts.blksync.tables['chunk.data'](Name.from('blksync.xsat').value.value).getTableRows()
+}
+
+const get_chunk_refs = () => {
+    return contracts.blksync.tables.chunkrefs(Name.from('blksync.xsat').value.value).getTableRows()
+}
+
+const get_merkle_cache = height => {
+    return contracts.blksync.tables.merklecache(BigInt(height)).getTableRows()
+}
+
+const get_block_headers = height => {
+    return contracts.blksync.tables.blockheaders(BigInt(height)).getTableRows()
+}
+
+const get_chunk_offsets = bucket_id => {
+    return contracts.blksync.tables.chunkoffsets(BigInt(bucket_id)).getTableRows()
+}
+
+const get_tx_offsets = bucket_id => {
+    return contracts.blksync.tables.txoffsets(BigInt(bucket_id)).getTableRows()
+}
+
 const get_block_bucket = synchronizer => {
     const scope = Name.from(synchronizer).value.value
     return contracts.blksync.tables.blockbuckets(scope).getTableRows()
@@ -65,6 +94,14 @@ const pushUpload = async (sender, height, hash, block) => {
     }
 }
 
+const pushChunks = (sender, height, hash, block) => {
+    const chunks = []
+    for (let offset = 0, chunk_id = 0; offset < block.length; offset += max_chunk_size, chunk_id++) {
+        chunks.push({ chunk_id, data: block.substring(offset, Math.min(offset + max_chunk_size, block.length)) })
+    }
+    return contracts.blksync.actions.pushchunks([sender, height, hash, chunks]).send(`${sender}@active`)
+}
+
 const pushChunk = (sender, height, hash, chunk_id, chunk) => {
     return contracts.blksync.actions.pushchunk([sender, height, hash, chunk_id, chunk]).send(`${sender}@active`)
 }
@@ -313,17 +350,54 @@ describe('blksync.xsat', () => {
     it('pushchunk', async () => {
         const height = 840000
         const hash = '0000000000000000000320283a032748cef8227873ff4872689bf23f1cda83a5'
-        await pushChunk('alice', height, hash, 0, getChunk(read_block(height), 1))
-        const chunks = get_block_chunks(1)
-        expect(chunks.length).toEqual(1)
+        const chunk = getChunk(read_block(height), 1)
+        await pushChunk('alice', height, hash, 0, chunk)
+        expect(get_block_chunks(1).length).toEqual(0)
+        expect(get_chunk_data().length).toEqual(1)
+        expect(get_chunk_refs()).toEqual([
+            { id: 1, hash: crypto.createHash('sha256').update(chunk).digest('hex'), size: chunk.length, num_refs: 1 },
+        ])
+        expect(get_chunk_offsets(1)).toEqual([{ chunks: [{ chunk_id: 0, offset: 0, size: chunk.length, data_id: 1 }] }])
+    })
+
+    it('pushchunk: same content is shared', async () => {
+        const height = 840000
+        const hash = '0000000000000000000320283a032748cef8227873ff4872689bf23f1cda83a5'
+        const block = read_block(height)
+        const chunk = getChunk(block, 1)
+        await pushChunk('alice', height, hash, 0, chunk)
+        expect(get_chunk_data().length).toEqual(1)
+        expect(get_chunk_refs()[0].num_refs).toEqual(1)
+        expect(get_chunk_offsets(1)).toEqual([{ chunks: [{ chunk_id: 0, offset: 0, size: chunk.length, data_id: 1 }] }])
+
+        // the same chunk pushed into the bucket of another synchronizer
+        const block_size = block.length / 2
+        const num_chunks = Math.ceil(block.length / max_chunk_size)
+        await contracts.blksync.actions
+            .initbucket(['bob', height, hash, block_size, num_chunks, max_chunk_size])
+            .send('bob@active')
+        await pushChunk('bob', height, hash, 0, chunk)
+        expect(get_chunk_data().length).toEqual(1)
+        expect(get_chunk_refs()).toEqual([
+            { id: 1, hash: crypto.createHash('sha256').update(chunk).digest('hex'), size: chunk.length, num_refs: 2 },
+        ])
+        expect(get_chunk_offsets(2)).toEqual([{ chunks: [{ chunk_id: 0, offset: 0, size: chunk.length, data_id: 1 }] }])
+
+        // the data survives as long as a bucket refers to it
+        await contracts.blksync.actions.delbucket(['bob', height, hash]).send('bob@active')
+        expect(get_chunk_data().length).toEqual(1)
+        expect(get_chunk_refs()[0].num_refs).toEqual(1)
+        expect(get_chunk_offsets(2)).toEqual([])
+        expect(get_chunk_offsets(1)).toEqual([{ chunks: [{ chunk_id: 0, offset: 0, size: chunk.length, data_id: 1 }] }])
     })
 
     it('delchunk', async () => {
         const height = 840000
         const hash = '0000000000000000000320283a032748cef8227873ff4872689bf23f1cda83a5'
         await contracts.blksync.actions.delchunk(['alice', height, hash, 0]).send('alice@active')
-        const chunks = get_block_chunks(1)
-        expect(chunks.length).toEqual(0)
+        expect(get_chunk_data().length).toEqual(0)
+        expect(get_chunk_refs()).toEqual([])
+        expect(get_chunk_offsets(1)).toEqual([{ chunks: [] }])
     })
 
     it('delbucket', async () => {
@@ -332,8 +406,9 @@ describe('blksync.xsat', () => {
         await pushUpload('alice', height, hash, read_block(height))
 
         await contracts.blksync.actions.delbucket(['alice', height, hash]).send('alice@active')
-        const rows = await get_block_chunks(1)
-        expect(rows.length).toEqual(0)
+        expect(get_chunk_data().length).toEqual(0)
+        expect(get_chunk_refs()).toEqual([])
+        expect(get_chunk_offsets(1)).toEqual([])
     })
 
     it('verify: merkle_invalid', async () => {
@@ -353,7 +428,7 @@ describe('blksync.xsat', () => {
 
         expect(get_block_bucket('alice')).toEqual([
             {
-                bucket_id: 2,
+                bucket_id: 3,
                 hash: '0000000000000000000320283a032748cef8227873ff4872689bf23f1cda83a5',
                 height: 840000,
                 num_chunks: 9,
@@ -388,7 +463,7 @@ describe('blksync.xsat', () => {
             .send('bob@active')
         expect(get_block_bucket('bob')).toEqual([
             {
-                bucket_id: 3,
+                bucket_id: 4,
                 hash: '0000000000000000000320283a032748cef8227873ff4872689bf23f1cda83a5',
                 height: 840000,
                 num_chunks: 9,
@@ -412,7 +487,7 @@ describe('blksync.xsat', () => {
 
         expect(get_block_bucket('bob')).toEqual([
             {
-                bucket_id: 3,
+                bucket_id: 4,
                 hash: '0000000000000000000320283a032748cef8227873ff4872689bf23f1cda83a5',
                 height: 840000,
                 num_chunks: 9,
@@ -440,10 +515,12 @@ describe('blksync.xsat', () => {
         await contracts.blksync.actions.verify(['bob', height, hash, get_nonce()]).send('bob@active')
         retval = decodeReturn_verify(blockchain.actionTraces[0].returnValue)
         expect(retval.status).toBe('verify_pass')
+        // the second verification round starts a new parse range
+        expect(get_tx_offsets(4)[0].offsets.map(offset => offset.transaction)).toEqual([2048])
         expect(get_pass_index(height)).toEqual([
             {
                 id: 1,
-                bucket_id: 3,
+                bucket_id: 4,
                 hash: '0000000000000000000320283a032748cef8227873ff4872689bf23f1cda83a5',
                 cumulative_work: '0000000000000000000000000000000000000000753bdab0e0d745453677442b',
                 synchronizer: 'bob',
@@ -454,7 +531,7 @@ describe('blksync.xsat', () => {
 
         expect(get_block_bucket('bob')).toEqual([
             {
-                bucket_id: 3,
+                bucket_id: 4,
                 hash: '0000000000000000000320283a032748cef8227873ff4872689bf23f1cda83a5',
                 height: 840000,
                 num_chunks: 9,
@@ -475,13 +552,25 @@ describe('blksync.xsat', () => {
                     previous_block_hash: '0000000000000000000172014ba58d66455762add0512355ad651207918494ab',
                     processed_position: 2325617,
                     processed_transactions: 3050,
-                    relay_header_merkle: [
+                    header_merkle_frontier: [
                         'e52ff6e4f7be9cf93f374f79941226df819d509a8b4e0ddb1b88124fbb6a18df',
-                        '0a310ba044ed34509e5e19d6327d2e925466870803b67bdb5e74787ff34abb3c',
+                        expect.any(String),
+                        expect.any(String),
+                        expect.any(String),
+                        expect.any(String),
+                        expect.any(String),
+                        expect.any(String),
+                        expect.any(String),
                     ],
-                    relay_witness_merkle: [
+                    witness_merkle_frontier: [
                         '075fc704b1a2333ee9c9bc832a8889e60a4f2bcdb3e5d872c75f7a0f6b8dc4f2',
-                        '3afde37403aaaaf752e3c4839e99643d9e4e9f75e2d20f5f87f1de13b51cc206',
+                        expect.any(String),
+                        expect.any(String),
+                        expect.any(String),
+                        expect.any(String),
+                        expect.any(String),
+                        expect.any(String),
+                        expect.any(String),
                     ],
                     witness_commitment: '88601d3d03ccce017fe2131c4c95a7292e4372983148e62996bb5e2de0e4d1d8',
                     witness_reserve_value: '0000000000000000000000000000000000000000000000000000000000000000',
@@ -516,9 +605,9 @@ describe('blksync.xsat', () => {
         await contracts.blkendt.actions.endorse(['alice', height, hash]).send('alice@active')
         await contracts.blkendt.actions.endorse(['anna', height, hash]).send('anna@active')
         await contracts.blkendt.actions.endorse(['brian', height, hash]).send('brian@active')
-        expect(get_consensus_block(3)).toEqual({
+        expect(get_consensus_block(4)).toEqual({
             bits: 386089497,
-            bucket_id: 3,
+            bucket_id: 4,
             cumulative_work: '0000000000000000000000000000000000000000753bdab0e0d745453677442b',
             hash: '0000000000000000000320283a032748cef8227873ff4872689bf23f1cda83a5',
             height: 840000,
@@ -534,7 +623,18 @@ describe('blksync.xsat', () => {
             parse: false,
             irreversible: false,
             created_at: TimePointSec.from(blockchain.timestamp).toString(),
+            branch_id: 3,
         })
+        expect(get_branches()).toEqual([
+            {
+                id: 3,
+                parent_id: 0,
+                start_height: 840000,
+                tip_height: 840000,
+                tip_hash: '0000000000000000000320283a032748cef8227873ff4872689bf23f1cda83a5',
+                cumulative_work: '0000000000000000000000000000000000000000753bdab0e0d745453677442b',
+            },
+        ])
         expect(get_block_bucket('bob')).toEqual([])
         expect(get_pass_index(height)).toEqual([])
     })
@@ -616,8 +716,23 @@ describe('blksync.xsat', () => {
         await contracts.blksync.actions
             .initbucket(['bob', height, hash, block_size, num_chunks, max_chunk_size])
             .send('bob@active')
-        // push upload
-        await pushUpload('bob', height, hash, read_block(height))
+        // push upload in one action
+        await expectToThrow(
+            contracts.blksync.actions
+                .pushchunks([
+                    'bob',
+                    height,
+                    hash,
+                    [
+                        { chunk_id: 0, data: block.substring(0, max_chunk_size) },
+                        { chunk_id: 0, data: block.substring(0, max_chunk_size) },
+                    ],
+                ])
+                .send('bob@active'),
+            'eosio_assert_message: 2026:blksync.xsat::pushchunks: duplicate chunk_id'
+        )
+        await pushChunks('bob', height, hash, block)
+        expect(get_block_bucket('bob')[0].status).toEqual(2)
         await contracts.blksync.actions.verify(['bob', height, hash, get_nonce()]).send('bob@active')
         await contracts.blksync.actions.verify(['bob', height, hash, get_nonce()]).send('bob@active')
         await contracts.blksync.actions.verify(['bob', height, hash, get_nonce()]).send('bob@active')
@@ -626,7 +741,7 @@ describe('blksync.xsat', () => {
         expect(get_pass_index(height)).toEqual([
             {
                 id: 1,
-                bucket_id: 6,
+                bucket_id: 7,
                 hash,
                 cumulative_work: '0000000000000000000000000000000000000000760a1c0decbd5f695365789e',
                 synchronizer: 'bob',
@@ -637,7 +752,7 @@ describe('blksync.xsat', () => {
 
         expect(get_block_bucket('bob')).toEqual([
             {
-                bucket_id: 6,
+                bucket_id: 7,
                 chunk_ids: [0, 1, 2, 3, 4, 5],
                 chunk_size: 524288,
                 hash: '00000000000000000001d2cbad2209f51143679b6797aef393a45e82eb88a9ae',
@@ -659,13 +774,27 @@ describe('blksync.xsat', () => {
                     previous_block_hash: '00000000000000000002bf1e60049e942ac34b728911adda77d704cc8401e84b',
                     processed_position: 1468566,
                     processed_transactions: 4084,
-                    relay_header_merkle: [
+                    header_merkle_frontier: [
                         'a0b4aee7c02e61bc6d392c1769a2b9771d6132942c384a392a87caecb9ef48eb',
-                        '9b6b0395488f3f79b530b6e16d9a089827d11aaa19eb69445b14361e6697bf9f',
+                        '641997bf1ab5efe01923f2865d2f74827f8c4039deac45a342d13d458246824b',
+                        '44a11727f8ea711c194cba6a3fead6a0b7e1dd1a71f3008b5e6f57d102f985fe',
+                        '548527ac562a087774afd0b8cd75bd3b7e0ab53bb8ceb8fa0df336f68ddc707d',
+                        '9dc320ce86d89ed61a8774aa04ae2b748e4ede1736253c14f29c0ff5eff2abea',
+                        'b76acdd718d1adb3e5f859560d726c1dd97c3cd07524834e91821ad47243e055',
+                        '8a573aae2a288a85650f85e50e6c79124e5a10dd0d930739992bb677e3b7b8ce',
+                        '41828fb74262162e862ed68aeddba1430211685b433176823df039a9eb9a69d3',
+                        'd55a8be9539447315e08c6066ca4a445751ab32867e9d673bf78f528802370d2',
                     ],
-                    relay_witness_merkle: [
+                    witness_merkle_frontier: [
                         '1a41c98aa411423289643b361e3154ad0cba7811db1091f7678bfbbc6d6e3e07',
-                        '18e839592af3da9e689c5de23f504b2f2729a35ca06ead4960c34070e1a95bf7',
+                        '736deb3587ef03e329bdf888e171e486d793d193332763040f5d89add00b854c',
+                        'd6f16b6e85a2f0925d34e2b1a94ea839a144ac89ba771e77938870d92719ce78',
+                        '11dbe5f4b61026cb8470294b57b3074065b8b1042d4eb5829ccbfd6a9f647508',
+                        'e45209bbf1dfbecaa2188bd7526d3500158e6070b63920b0d9e44b4ca411a032',
+                        'ea667d41766774cd7a6d6526e4fb8a4d61971af5b1d3446800f49ce284cac03b',
+                        '7ed918b20cb1f03dbb7de4801af6f88a81381b21abf29d746f073f05f4923f30',
+                        'ebf30bf7bf4fdd793295fdc1be49b142ef547ab66c0d11f20fda806f4945b44a',
+                        '9096251636786ff009adcb4d7ff1d180c9d2608e0c934fbff9ed5817747af202',
                     ],
                     timestamp: 1713970312,
                     witness_commitment: '48c962c91d8edc8a7a184c50ce5c14174ef40c9dcfc22ac661f6c648a3e00240',
@@ -674,6 +803,38 @@ describe('blksync.xsat', () => {
                 },
             },
         ])
+
+        // buckets with the same chunks skip check_merkle
+        expect(get_merkle_cache(height)).toEqual([
+            {
+                id: 0,
+                hash,
+                digest: expect.any(String),
+                verify_info: get_block_bucket('bob')[0].verify_info,
+                tx_offsets: get_tx_offsets(7)[0].offsets,
+            },
+        ])
+    })
+
+    it('verify: reuse the merkle verification of a bucket with the same chunks', async () => {
+        const height = 840672
+        const hash = '00000000000000000001d2cbad2209f51143679b6797aef393a45e82eb88a9ae'
+        const block = read_block(height)
+        const block_size = block.length / 2
+        const num_chunks = Math.ceil(block.length / max_chunk_size)
+        await contracts.blksync.actions
+            .initbucket(['anna', height, hash, block_size, num_chunks, max_chunk_size])
+            .send('anna@active')
+        await pushChunks('anna', height, hash, block)
+        await contracts.blksync.actions.verify(['anna', height, hash, get_nonce()]).send('anna@active')
+
+        // skips check_merkle and keeps the parse ranges of the cached bucket
+        const block_bucket = get_block_bucket('anna')[0]
+        expect(block_bucket.status).toEqual(4)
+        expect(block_bucket.verify_info).toEqual(get_merkle_cache(height)[0].verify_info)
+        expect(get_tx_offsets(block_bucket.bucket_id)).toEqual(get_tx_offsets(7))
+
+        await contracts.blksync.actions.delbucket(['anna', height, hash]).send('anna@active')
     })
 
     it('delbucket: 840672', async () => {
@@ -682,6 +843,21 @@ describe('blksync.xsat', () => {
         await contracts.blksync.actions.delbucket(['bob', height, hash]).send('bob@active')
     })
 
+    it('erase: missing required authority', async () => {
+        await expectToThrow(
+            contracts.blksync.actions.erase([840672]).send('alice@active'),
+            'missing required authority utxomng.xsat'
+        )
+    })
+
+    it('erase: merkle cache of blocks that never reached consensus', async () => {
+        const height = 840672
+        // the buckets of 840672 were deleted without reaching consensus
+        expect(get_merkle_cache(height).length).toEqual(1)
+        await contracts.blksync.actions.erase([height]).send('utxomng.xsat@active')
+        expect(get_merkle_cache(height)).toEqual([])
+    })
+
     it('reinitialize the bucket and push the chunk need to update updated_at', async () => {
         const height = 840001
         const hash = '00000000000000000001b48a75d5a3077913f3f441eb7e08c13c43f768db2463'
@@ -758,4 +934,117 @@ describe('blksync.xsat', () => {
             'eosio_assert_message: 2015:blksync.xsat::delchunk: cannot delete chunk in the current state [waiting_miner_verification]'
         )
     })
+
+    it('verifymode: missing required authority', async () => {
+        await expectToThrow(
+            contracts.blksync.actions.verifymode(['anna', true]).send('alice@active'),
+            'missing required authority anna'
+        )
+    })
+
+    it('verify on upload', async () => {
+        const height = 840672
+        const hash = '00000000000000000001d2cbad2209f51143679b6797aef393a45e82eb88a9ae'
+        const block = read_block(height)
+        const block_size = block.length / 2
+        const num_chunks = Math.ceil(block.length / max_chunk_size)
+        const chunk = chunk_id => block.substring(chunk_id * max_chunk_size, (chunk_id + 1) * max_chunk_size)
+        await contracts.blksync.actions.verifymode(['anna', true]).send('anna@active')
+        await contracts.blksync.actions
+            .initbucket(['anna', height, hash, block_size, num_chunks, max_chunk_size])
+            .send('anna@active')
+
+        // the complete transactions of the first chunk are verified
+        await pushChunk('anna', height, hash, 0, chunk(0))
+        const verify_info = get_block_bucket('anna')[0].verify_info
+        expect(get_block_bucket('anna')[0].status).toEqual(1)
+        expect(verify_info.processed_transactions).toBeGreaterThan(0)
+
+        // non-contiguous chunks are not verified
+        await pushChunk('anna', height, hash, 2, chunk(2))
+        expect(get_block_bucket('anna')[0].verify_info).toEqual(verify_info)
+
+        await expectToThrow(
+            pushChunk('anna', height, hash, 0, chunk(0)),
+            'eosio_assert_message: 2028:blksync.xsat::pushchunk: cannot replace a chunk that has been verified'
+        )
+        await expectToThrow(
+            contracts.blksync.actions.delchunk(['anna', height, hash, 0]).send('anna@active'),
+            'eosio_assert_message: 2029:blksync.xsat::delchunk: cannot delete a chunk that has been verified'
+        )
+
+        for (let chunk_id = 1; chunk_id < num_chunks; chunk_id++) {
+            if (chunk_id == 2) continue
+            await pushChunk('anna', height, hash, chunk_id, chunk(chunk_id))
+        }
+        expect(get_block_bucket('anna')[0].status).toEqual(2)
+        expect(get_block_bucket('anna')[0].verify_info.processed_transactions).toBeGreaterThan(
+            verify_info.processed_transactions
+        )
+
+        await contracts.blksync.actions.verify(['anna', height, hash, get_nonce()]).send('anna@active')
+        expect(get_block_bucket('anna')[0].status).toEqual(4)
+
+        await contracts.blksync.actions.verifymode(['anna', false]).send('anna@active')
+    })
+
+    it('config: missing required authority', async () => {
+        await expectToThrow(
+            contracts.blksync.actions.config([true]).send('alice@active'),
+            'missing required authority blksync.xsat'
+        )
+    })
+
+    it('pushheaders', async () => {
+        const height = 840672
+        const hash = '00000000000000000001d2cbad2209f51143679b6797aef393a45e82eb88a9ae'
+        const header = read_block(height).substring(0, 160)
+
+        await expectToThrow(
+            contracts.blksync.actions.pushheaders(['amy', height, header]).send('amy@active'),
+            'eosio_assert_message: 2032:blksync.xsat::pushheaders: not an synchronizer account'
+        )
+        await expectToThrow(
+            contracts.blksync.actions.pushheaders(['anna', height, header.substring(0, 158)]).send('anna@active'),
+            'eosio_assert_message: 2031:blksync.xsat::pushheaders: headers must be a non-empty sequence of 80-byte block headers'
+        )
+        // change the nonce
+        await expectToThrow(
+            contracts.blksync.actions.pushheaders(['anna', height, header.substring(0, 152) + '00000000']).send('anna@active'),
+            'eosio_assert_message: 2034:blksync.xsat::pushheaders: invalid_target'
+        )
+
+        await contracts.blksync.actions.pushheaders(['anna', height, header]).send('anna@active')
+        // pushing the same header again is a no-op
+        await contracts.blksync.actions.pushheaders(['anna', height, header]).send('anna@active')
+        expect(get_block_headers(height)).toEqual([
+            {
+                id: 0,
+                hash,
+                previous_block_hash: '00000000000000000002bf1e60049e942ac34b728911adda77d704cc8401e84b',
+                cumulative_work: '0000000000000000000000000000000000000000760a1c0decbd5f695365789e',
+                timestamp: 1713970312,
+                bits: 386085339,
+            },
+        ])
+    })
+
+    it('erase: block headers of the height', async () => {
+        const height = 840672
+        // the header was pushed but no bucket of it reached consensus
+        expect(get_block_headers(height).length).toEqual(1)
+        await contracts.blksync.actions.erase([height]).send('utxomng.xsat@active')
+        expect(get_block_headers(height)).toEqual([])
+    })
+
+    it('initbucket: the block header has not been pushed', async () => {
+        const height = 840673
+        const hash = '00000000000000000000f2b3ad32ea5a4ad8f2ea8e2ea0e0c0b7d84e8fd2c8d1'
+        await contracts.blksync.actions.config([true]).send('blksync.xsat@active')
+        await expectToThrow(
+            contracts.blksync.actions.initbucket(['anna', height, hash, 1000, 1, max_chunk_size]).send('anna@active'),
+            'eosio_assert_message: 2037:blksync.xsat::initbucket: the block header has not been pushed'
+        )
+        await contracts.blksync.actions.config([false]).send('blksync.xsat@active')
+    })
 })
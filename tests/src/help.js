@@ -34,6 +34,78 @@ const decodeReturn_verify = returnValue => {
     }
 }
 
+// reads the abi encoded return value of an action
+const returnReader = returnValue => {
+    let offset = 0
+    const read = size => returnValue.subarray(offset, (offset += size))
+    const reader = {
+        uint8: () => read(1)[0],
+        uint32: () => read(4).readUInt32LE(0),
+        uint64: () => read(8).readBigUInt64LE(0),
+        varuint32: () => {
+            let value = 0
+            let shift = 0
+            let byte
+            do {
+                byte = read(1)[0]
+                value += (byte & 0x7f) * 2 ** shift
+                shift += 7
+            } while (byte & 0x80)
+            return value
+        },
+        checksum256: () => read(32).toString('hex'),
+        string: () => read(reader.varuint32()).toString(),
+        bytes: () => read(reader.varuint32()).toString('hex'),
+        optional: decode => (reader.uint8() ? decode() : null),
+        vector: decode => Array.from({ length: reader.varuint32() }, () => decode()),
+    }
+    return reader
+}
+
+const read_snapshot_utxo = reader => ({
+    txid: reader.checksum256(),
+    index: reader.uint32(),
+    script_type: reader.uint8(),
+    scriptpubkey: reader.bytes(),
+    value: Number(reader.uint64()),
+})
+
+const decodeReturn_exportutxos = returnValue => {
+    const reader = returnReader(returnValue)
+    return {
+        height: Number(reader.uint64()),
+        utxo_set_hash: reader.checksum256(),
+        utxos: reader.vector(() => read_snapshot_utxo(reader)),
+        next_id: reader.optional(() => reader.uint64().toString()),
+    }
+}
+
+const decodeReturn_getutxo = returnValue => {
+    const reader = returnReader(returnValue)
+    return reader.optional(() => read_snapshot_utxo(reader))
+}
+
+const decodeReturn_getutxos = returnValue => {
+    const reader = returnReader(returnValue)
+    return {
+        utxos: reader.vector(() => ({
+            txid: reader.checksum256(),
+            index: reader.uint32(),
+            value: Number(reader.uint64()),
+        })),
+        cursor: reader.optional(() => reader.uint64().toString()),
+    }
+}
+
+const decodeReturn_processblock = returnValue => {
+    const reader = returnReader(returnValue)
+    return {
+        status: reader.string(),
+        height: Number(reader.uint64()),
+        block_hash: reader.checksum256(),
+    }
+}
+
 const max_chunk_size = 512 * 1024
 
 module.exports = {
@@ -41,5 +113,9 @@ module.exports = {
     addTime,
     subTime,
     decodeReturn_verify,
+    decodeReturn_exportutxos,
+    decodeReturn_getutxo,
+    decodeReturn_getutxos,
+    decodeReturn_processblock,
     max_chunk_size,
 }
@@ -3,7 +3,15 @@ const { Blockchain, expectToThrow } = require('@proton/vert')
 const { BTC, BTC_CONTRACT } = require('./src/constants')
 const fs = require('fs')
 const path = require('path')
-const { addTime, decodeReturn_verify, max_chunk_size } = require('./src/help')
+const {
+    addTime,
+    decodeReturn_verify,
+    decodeReturn_exportutxos,
+    decodeReturn_getutxo,
+    decodeReturn_getutxos,
+    decodeReturn_processblock,
+    max_chunk_size,
+} = require('./src/help')
 
 // Vert EOS VM
 const blockchain = new Blockchain()
@@ -31,10 +39,21 @@ const get_utxo = id => {
     return contracts.utxomng.tables.utxos().getTableRow(BigInt(id))
 }
 
+const get_balance = scripthash => {
+    return contracts.utxomng.tables
+        .balances()
+        .getTableRows()
+        .find(row => row.scripthash == scripthash)
+}
+
 const get_chain_state = () => {
     return contracts.utxomng.tables.chainstate().getTableRows()[0]
 }
 
+const get_block_parsing = () => {
+    return contracts.utxomng.tables.parsingprogs().getTableRows()
+}
+
 const get_consensus_block = bucket_id => {
     if (bucket_id) {
         return contracts.utxomng.tables.consensusblk().getTableRow(BigInt(bucket_id))
@@ -43,10 +62,44 @@ const get_consensus_block = bucket_id => {
     }
 }
 
+const get_parse_ranges = bucket_id => {
+    return contracts.utxomng.tables.parseranges(BigInt(bucket_id)).getTableRows()
+}
+
+const get_pending_utxos = bucket_id => {
+    return contracts.utxomng.tables
+        .pendingpages(BigInt(bucket_id))
+        .getTableRows()
+        .flatMap(row => row.utxos)
+}
+
+// page and slot of the pending utxo of an outpoint
+const find_pending_utxo = (bucket_id, txid, index) => {
+    for (const row of contracts.utxomng.tables.pendingpages(BigInt(bucket_id)).getTableRows()) {
+        const slot = row.utxos.findIndex(utxo => utxo.txid == txid && utxo.index == index)
+        if (slot >= 0) return { page: String(row.page), slot, utxo: row.utxos[slot] }
+    }
+}
+
+const get_pending_index = bucket_id => {
+    return contracts.utxomng.tables
+        .pendingindex(BigInt(bucket_id))
+        .getTableRows()
+        .map(({ page, slot }) => ({ page: String(page), slot }))
+}
+
+const get_spent_utxos = () => {
+    return contracts.utxomng.tables.spentutxos().getTableRows()
+}
+
 const get_block = height => {
     return contracts.utxomng.tables.blocks().getTableRow(BigInt(height))
 }
 
+const get_header_ring = height => {
+    return contracts.utxomng.tables.headerring().getTableRow(BigInt(height % 4032))
+}
+
 const get_config = () => {
     return contracts.utxomng.tables.config().getTableRows()[0]
 }
@@ -72,6 +125,16 @@ const pushChunk = (sender, height, hash, chunk_id, chunk) => {
 
 const get_nonce = () => new Date().getTime()
 
+// the block parser parses its own range, then claims the remaining ranges of a split block in later actions
+const parse_block = async synchronizer => {
+    let max_times = 10
+    while (max_times--) {
+        await contracts.utxomng.actions.processblock([synchronizer, 0, get_nonce()]).send(`${synchronizer}@active`)
+        const retval = decodeReturn_processblock(blockchain.actionTraces[0].returnValue)
+        if (retval.status == 'parsing_completed') break
+    }
+}
+
 // one-time setup
 beforeAll(async () => {
     blockchain.setTime(TimePointSec.from(new Date()))
@@ -179,6 +242,36 @@ describe('utxomng.xsat', () => {
         expect(blockchain.actionTraces[0].returnValue[0]).toEqual(0)
     })
 
+    const snapshot_utxo = {
+        txid: 'a0db149ace545beabbd87a8d6b20ffd6aa3b5a50e58add49a3d435f898c272cf',
+        index: 1,
+        script_type: 1,
+        scriptpubkey: '536ffa992491508dca0354e52f32a3a7a679a53a',
+        value: 4075061499,
+    }
+    // leading 8 bytes of the outpoint digest
+    const snapshot_utxo_id = '11053057471301555173'
+
+    it('spentutxos: ids continue from the table when next_spent_utxo_id is absent', async () => {
+        await contracts.utxomng.actions
+            .addspentutxo([
+                5,
+                839999,
+                snapshot_utxo.txid,
+                0,
+                '76a914536ffa992491508dca0354e52f32a3a7a679a53a88ac',
+                1000,
+            ])
+            .send('utxomng.xsat@active')
+        await contracts.utxomng.actions.importutxos([839999, [snapshot_utxo], null]).send('utxomng.xsat@active')
+        expect(get_chain_state().next_spent_utxo_id).toEqual(6)
+
+        await contracts.utxomng.actions.delutxo([snapshot_utxo_id]).send('utxomng.xsat@active')
+        await contracts.utxomng.actions.cleartable(['spentutxos', null, null]).send('utxomng.xsat@active')
+        await contracts.utxomng.actions.cleartable(['chainstate', null, null]).send('utxomng.xsat@active')
+        expect(get_chain_state()).toEqual(undefined)
+    })
+
     it('addutxo: missing required authority', async () => {
         await expectToThrow(
             contracts.utxomng.actions
@@ -202,13 +295,42 @@ describe('utxomng.xsat', () => {
             txid: 'a0db149ace545beabbd87a8d6b20ffd6aa3b5a50e58add49a3d435f898c272cf',
             value: 4075061499,
         }
+        // p2pkh is stored as the pubkey hash
+        const compressed_utxo = {
+            ...utxo,
+            scriptpubkey: '536ffa992491508dca0354e52f32a3a7a679a53a',
+            script_type: 1,
+            counted: true,
+        }
+        // sha256 of txid, index, value and the decompressed scriptpubkey
+        const utxo_set_hash = 'c58a9bb102a9fac784a832f022bd139ae086b93dfb29a525fc58755f32f411a0'
         await contracts.utxomng.actions.addutxo(utxo).send('utxomng.xsat@active')
-        expect(get_utxo(1)).toEqual(utxo)
+        expect(get_utxo(1)).toEqual(compressed_utxo)
         expect(get_chain_state().num_utxos).toEqual(1)
+        expect(get_chain_state().utxo_set_hash).toEqual(utxo_set_hash)
+        // sha256 of the decompressed scriptpubkey
+        const balance = {
+            scripthash: '68616b4e3a395a51a095185b74890179a530268e0d43bc148c98f19e4aafe449',
+            value: 4075061499,
+            num_utxos: 1,
+            height: 839999,
+        }
+        expect((({ id, ...row }) => row)(get_balance(balance.scripthash))).toEqual(balance)
         // update
         await contracts.utxomng.actions.addutxo(utxo).send('utxomng.xsat@active')
-        expect(get_utxo(1)).toEqual(utxo)
+        expect(get_utxo(1)).toEqual(compressed_utxo)
         expect(get_chain_state().num_utxos).toEqual(1)
+        expect(get_chain_state().utxo_set_hash).toEqual(utxo_set_hash)
+        expect((({ id, ...row }) => row)(get_balance(balance.scripthash))).toEqual(balance)
+    })
+
+    it('find_utxo: rows with sequential ids', async () => {
+        // the row added with id 1 is found through the outpoint index
+        await expectToThrow(
+            contracts.utxomng.actions.importutxos([839999, [snapshot_utxo], null]).send('utxomng.xsat@active'),
+            'eosio_assert: utxomng.xsat::importutxos: [utxos] already exists'
+        )
+        expect(get_utxo(snapshot_utxo_id)).toEqual(undefined)
     })
 
     it('delutxo: missing required authority utxomng.xsat', async () => {
@@ -228,6 +350,7 @@ describe('utxomng.xsat', () => {
     it('delutxo', async () => {
         await contracts.utxomng.actions.delutxo([1]).send('utxomng.xsat@active')
         expect(get_utxo(1)).toEqual(undefined)
+        expect(get_balance('68616b4e3a395a51a095185b74890179a530268e0d43bc148c98f19e4aafe449')).toEqual(undefined)
         expect(get_chain_state()).toEqual({
             head_height: 0,
             irreversible_height: 0,
@@ -246,9 +369,306 @@ describe('utxomng.xsat', () => {
             parser: '',
             num_validators_assigned: 0,
             num_provider_validators: 0,
+            next_spent_utxo_id: 1,
+            utxo_set_hash: '0000000000000000000000000000000000000000000000000000000000000000',
         })
     })
 
+    it('delutxo: utxos saved before balances are not subtracted', async () => {
+        const scriptpubkey = '76a914536ffa992491508dca0354e52f32a3a7a679a53a88ac'
+        await contracts.utxomng.actions
+            .addutxo({ id: 1, txid: snapshot_utxo.txid, index: 0, scriptpubkey, value: 1000 })
+            .send('utxomng.xsat@active')
+        await contracts.utxomng.actions
+            .addlegacyutxo([2, snapshot_utxo.txid, 2, scriptpubkey, 5000])
+            .send('utxomng.xsat@active')
+        const balance = {
+            scripthash: '68616b4e3a395a51a095185b74890179a530268e0d43bc148c98f19e4aafe449',
+            value: 1000,
+            num_utxos: 1,
+            height: 839999,
+        }
+        expect((({ id, ...row }) => row)(get_balance(balance.scripthash))).toEqual(balance)
+        const { utxo_set_hash } = get_chain_state()
+
+        await contracts.utxomng.actions.delutxo([2]).send('utxomng.xsat@active')
+        expect((({ id, ...row }) => row)(get_balance(balance.scripthash))).toEqual(balance)
+        expect(get_chain_state().utxo_set_hash).toEqual(utxo_set_hash)
+        await contracts.utxomng.actions.delutxo([1]).send('utxomng.xsat@active')
+        expect(get_balance(balance.scripthash)).toEqual(undefined)
+
+        // the legacy row was counted in neither num_utxos nor the utxo set hash
+        await contracts.utxomng.actions.cleartable(['chainstate', null, null]).send('utxomng.xsat@active')
+        expect(get_chain_state()).toEqual(undefined)
+    })
+
+    it('countutxos: missing required authority', async () => {
+        await expectToThrow(
+            contracts.utxomng.actions.countutxos([0, 1]).send('alice@active'),
+            'missing required authority utxomng.xsat'
+        )
+    })
+
+    it('countutxos: backfill balances and the utxo set hash with utxos saved before the upgrade', async () => {
+        const scriptpubkey = '76a914536ffa992491508dca0354e52f32a3a7a679a53a88ac'
+        const scripthash = '68616b4e3a395a51a095185b74890179a530268e0d43bc148c98f19e4aafe449'
+        await contracts.utxomng.actions
+            .addlegacyutxo([1, snapshot_utxo.txid, 0, scriptpubkey, 1000])
+            .send('utxomng.xsat@active')
+        await contracts.utxomng.actions
+            .addlegacyutxo([2, snapshot_utxo.txid, 2, scriptpubkey, 5000])
+            .send('utxomng.xsat@active')
+        expect(get_balance(scripthash)).toEqual(undefined)
+        // the chain state was cleared by the previous test
+        expect(get_chain_state()).toEqual(undefined)
+        const zero_hash = '0000000000000000000000000000000000000000000000000000000000000000'
+        const get_script_utxos = async () => {
+            await contracts.utxomng.actions.getutxos([scriptpubkey, 0, 10]).send('alice@active')
+            return decodeReturn_getutxos(blockchain.actionTraces[0].returnValue).utxos
+        }
+        // legacy rows are not in the index that getutxos pages through
+        expect(await get_script_utxos()).toEqual([])
+
+        await contracts.utxomng.actions.countutxos([0, 1]).send('utxomng.xsat@active')
+        expect(await get_script_utxos()).toEqual([{ txid: snapshot_utxo.txid, index: 0, value: 1000 }])
+        expect(get_utxo(1).counted).toEqual(true)
+        expect(get_utxo(1).script_type).toEqual(0)
+        expect(get_utxo(2).counted).toEqual(undefined)
+        const balance = { scripthash, value: 1000, num_utxos: 1, height: 839999 }
+        expect((({ id, ...row }) => row)(get_balance(scripthash))).toEqual(balance)
+        await contracts.utxomng.actions.countutxos([2, 1]).send('utxomng.xsat@active')
+        expect((({ id, ...row }) => row)(get_balance(scripthash))).toEqual({ ...balance, value: 6000, num_utxos: 2 })
+        expect(await get_script_utxos()).toEqual([
+            { txid: snapshot_utxo.txid, index: 0, value: 1000 },
+            { txid: snapshot_utxo.txid, index: 2, value: 5000 },
+        ])
+
+        const { utxo_set_hash } = get_chain_state()
+        expect(utxo_set_hash).not.toEqual(zero_hash)
+
+        // counted rows are skipped
+        await contracts.utxomng.actions.countutxos([0, 10]).send('utxomng.xsat@active')
+        expect((({ id, ...row }) => row)(get_balance(scripthash))).toEqual({ ...balance, value: 6000, num_utxos: 2 })
+        expect(get_chain_state().utxo_set_hash).toEqual(utxo_set_hash)
+
+        // the backfilled rows are subtracted when removed
+        await contracts.utxomng.actions.delutxo([1]).send('utxomng.xsat@active')
+        expect((({ id, ...row }) => row)(get_balance(scripthash))).toEqual({ ...balance, value: 5000 })
+        await contracts.utxomng.actions.delutxo([2]).send('utxomng.xsat@active')
+        expect(get_balance(scripthash)).toEqual(undefined)
+        expect(get_chain_state().utxo_set_hash).toEqual(zero_hash)
+
+        // the legacy rows were not counted in num_utxos
+        await contracts.utxomng.actions.cleartable(['chainstate', null, null]).send('utxomng.xsat@active')
+        expect(get_chain_state()).toEqual(undefined)
+    })
+
+    it('importutxos: missing required authority', async () => {
+        await expectToThrow(
+            contracts.utxomng.actions.importutxos([839999, [], null]).send('alice@active'),
+            'missing required authority utxomng.xsat'
+        )
+    })
+
+    it('importutxos: snapshot height must be 839999', async () => {
+        await expectToThrow(
+            contracts.utxomng.actions.importutxos([840000, [], null]).send('utxomng.xsat@active'),
+            'eosio_assert: utxomng.xsat::importutxos: snapshot height must be 839999'
+        )
+    })
+
+    it('importutxos: utxo set hash mismatch', async () => {
+        await expectToThrow(
+            contracts.utxomng.actions
+                .importutxos([839999, [snapshot_utxo], '0000000000000000000000000000000000000000000000000000000000000001'])
+                .send('utxomng.xsat@active'),
+            'eosio_assert: utxomng.xsat::importutxos: utxo set hash mismatch'
+        )
+    })
+
+    it('importutxos', async () => {
+        const utxo_set_hash = 'c58a9bb102a9fac784a832f022bd139ae086b93dfb29a525fc58755f32f411a0'
+        await contracts.utxomng.actions
+            .importutxos([839999, [snapshot_utxo], utxo_set_hash])
+            .send('utxomng.xsat@active')
+        const { id, ...utxo } = get_utxo(snapshot_utxo_id)
+        expect(utxo).toEqual({ ...snapshot_utxo, counted: true })
+        expect(get_chain_state().num_utxos).toEqual(1)
+        expect(get_chain_state().utxo_set_hash).toEqual(utxo_set_hash)
+
+        await expectToThrow(
+            contracts.utxomng.actions.importutxos([839999, [snapshot_utxo], null]).send('utxomng.xsat@active'),
+            'eosio_assert: utxomng.xsat::importutxos: [utxos] already exists'
+        )
+
+        await contracts.utxomng.actions.delutxo([snapshot_utxo_id]).send('utxomng.xsat@active')
+        expect(get_chain_state().num_utxos).toEqual(0)
+        expect(get_chain_state().utxo_set_hash).toEqual('0000000000000000000000000000000000000000000000000000000000000000')
+    })
+
+    it('importutxos: unknown script template', async () => {
+        await expectToThrow(
+            contracts.utxomng.actions
+                .importutxos([839999, [{ ...snapshot_utxo, script_type: 6 }], null])
+                .send('utxomng.xsat@active'),
+            'eosio_assert: utxomng.xsat::importutxos: [script_type] unknown script template'
+        )
+    })
+
+    it('importutxos: scriptpubkey does not match the script template', async () => {
+        await expectToThrow(
+            contracts.utxomng.actions
+                .importutxos([839999, [{ ...snapshot_utxo, script_type: 4 }], null])
+                .send('utxomng.xsat@active'),
+            'eosio_assert: utxomng.xsat::importutxos: [scriptpubkey] does not match the script template'
+        )
+        await expectToThrow(
+            contracts.utxomng.actions
+                .importutxos([839999, [{ ...snapshot_utxo, scriptpubkey: snapshot_utxo.scriptpubkey.slice(2) }], null])
+                .send('utxomng.xsat@active'),
+            'eosio_assert: utxomng.xsat::importutxos: [scriptpubkey] does not match the script template'
+        )
+    })
+
+    it('exportutxos: import the exported pages', async () => {
+        const p2wpkh_utxo = {
+            txid: '5cdb277afa34ea35aa620e5cad205f18acda80b80dec9dacf4b84636a5ad0448',
+            index: 0,
+            script_type: 3,
+            scriptpubkey: '536ffa992491508dca0354e52f32a3a7a679a53a',
+            value: 1000,
+        }
+        const p2wpkh_utxo_id = '16572454927451983366'
+        await contracts.utxomng.actions
+            .importutxos([839999, [snapshot_utxo, p2wpkh_utxo], null])
+            .send('utxomng.xsat@active')
+        const { utxo_set_hash } = get_chain_state()
+
+        await contracts.utxomng.actions.exportutxos([0, 1]).send('alice@active')
+        const first_page = decodeReturn_exportutxos(blockchain.actionTraces[0].returnValue)
+        expect(first_page).toEqual({
+            height: get_chain_state().irreversible_height,
+            utxo_set_hash,
+            utxos: [snapshot_utxo],
+            next_id: p2wpkh_utxo_id,
+        })
+        await contracts.utxomng.actions.exportutxos([first_page.next_id, 1]).send('alice@active')
+        const last_page = decodeReturn_exportutxos(blockchain.actionTraces[0].returnValue)
+        expect(last_page.utxos).toEqual([p2wpkh_utxo])
+        expect(last_page.next_id).toEqual(null)
+
+        await contracts.utxomng.actions.delutxo([snapshot_utxo_id]).send('utxomng.xsat@active')
+        await contracts.utxomng.actions.delutxo([p2wpkh_utxo_id]).send('utxomng.xsat@active')
+        await contracts.utxomng.actions.importutxos([839999, first_page.utxos, null]).send('utxomng.xsat@active')
+        await contracts.utxomng.actions
+            .importutxos([839999, last_page.utxos, utxo_set_hash])
+            .send('utxomng.xsat@active')
+        expect((({ id, ...row }) => row)(get_utxo(snapshot_utxo_id))).toEqual({ ...snapshot_utxo, counted: true })
+        expect((({ id, ...row }) => row)(get_utxo(p2wpkh_utxo_id))).toEqual({ ...p2wpkh_utxo, counted: true })
+        expect(get_chain_state().num_utxos).toEqual(2)
+
+        await contracts.utxomng.actions.delutxo([snapshot_utxo_id]).send('utxomng.xsat@active')
+        await contracts.utxomng.actions.delutxo([p2wpkh_utxo_id]).send('utxomng.xsat@active')
+        expect(get_chain_state().num_utxos).toEqual(0)
+    })
+
+    it('getutxo', async () => {
+        await contracts.utxomng.actions.importutxos([839999, [snapshot_utxo], null]).send('utxomng.xsat@active')
+        await contracts.utxomng.actions.getutxo([snapshot_utxo.txid, 1]).send('alice@active')
+        expect(decodeReturn_getutxo(blockchain.actionTraces[0].returnValue)).toEqual(snapshot_utxo)
+        await contracts.utxomng.actions.getutxo([snapshot_utxo.txid, 2]).send('alice@active')
+        expect(decodeReturn_getutxo(blockchain.actionTraces[0].returnValue)).toEqual(null)
+
+        await contracts.utxomng.actions.delutxo([snapshot_utxo_id]).send('utxomng.xsat@active')
+        await contracts.utxomng.actions.getutxo([snapshot_utxo.txid, 1]).send('alice@active')
+        expect(decodeReturn_getutxo(blockchain.actionTraces[0].returnValue)).toEqual(null)
+    })
+
+    it('getutxos: limit must be greater than 0', async () => {
+        await expectToThrow(
+            contracts.utxomng.actions.getutxos(['', 0, 0]).send('alice@active'),
+            'eosio_assert: utxomng.xsat::getutxos: limit must be greater than 0'
+        )
+    })
+
+    it('getutxos: page with the cursor', async () => {
+        const scriptpubkey = '76a914536ffa992491508dca0354e52f32a3a7a679a53a88ac'
+        // in primary key order
+        const utxos = [2, 1, 3].map(index => ({ txid: snapshot_utxo.txid, index, value: 1000 * index }))
+        const utxo_ids = ['10373135069580166266', '11053057471301555173', '15621622990708221365']
+        await contracts.utxomng.actions
+            .importutxos([
+                839999,
+                utxos.map(utxo => ({ ...utxo, script_type: 1, scriptpubkey: snapshot_utxo.scriptpubkey })),
+                null,
+            ])
+            .send('utxomng.xsat@active')
+
+        await contracts.utxomng.actions.getutxos([scriptpubkey, 0, 2]).send('alice@active')
+        const first_page = decodeReturn_getutxos(blockchain.actionTraces[0].returnValue)
+        expect(first_page).toEqual({ utxos: utxos.slice(0, 2), cursor: utxo_ids[2] })
+        await contracts.utxomng.actions.getutxos([scriptpubkey, first_page.cursor, 2]).send('alice@active')
+        expect(decodeReturn_getutxos(blockchain.actionTraces[0].returnValue)).toEqual({
+            utxos: utxos.slice(2),
+            cursor: null,
+        })
+
+        // the utxo of the cursor is spent before the next page is read
+        await contracts.utxomng.actions.getutxos([scriptpubkey, 0, 1]).send('alice@active')
+        const spent_page = decodeReturn_getutxos(blockchain.actionTraces[0].returnValue)
+        expect(spent_page).toEqual({ utxos: utxos.slice(0, 1), cursor: utxo_ids[1] })
+        await contracts.utxomng.actions.delutxo([utxo_ids[1]]).send('utxomng.xsat@active')
+        await contracts.utxomng.actions.getutxos([scriptpubkey, spent_page.cursor, 1]).send('alice@active')
+        expect(decodeReturn_getutxos(blockchain.actionTraces[0].returnValue)).toEqual({
+            utxos: utxos.slice(2),
+            cursor: null,
+        })
+
+        await contracts.utxomng.actions.delutxo([utxo_ids[0]]).send('utxomng.xsat@active')
+        await contracts.utxomng.actions.delutxo([utxo_ids[2]]).send('utxomng.xsat@active')
+        expect(get_chain_state().num_utxos).toEqual(0)
+    })
+
+    it('importutxos: probe the next key on a digest key collision', async () => {
+        // another outpoint already holds the digest key of the snapshot utxo
+        const colliding_utxo = {
+            txid: snapshot_utxo.txid,
+            index: 2,
+            scriptpubkey: '76a914536ffa992491508dca0354e52f32a3a7a679a53a88ac',
+            value: 1000,
+        }
+        await contracts.utxomng.actions
+            .addutxo({ id: snapshot_utxo_id, ...colliding_utxo })
+            .send('utxomng.xsat@active')
+        await contracts.utxomng.actions.importutxos([839999, [snapshot_utxo], null]).send('utxomng.xsat@active')
+        expect((({ id, ...row }) => row)(get_utxo(snapshot_utxo_id))).toEqual({
+            ...colliding_utxo,
+            scriptpubkey: '536ffa992491508dca0354e52f32a3a7a679a53a',
+            script_type: 1,
+            counted: true,
+        })
+        const probed_utxo_id = '11053057471301555174'
+        expect((({ id, ...row }) => row)(get_utxo(probed_utxo_id))).toEqual({ ...snapshot_utxo, counted: true })
+        expect(get_chain_state().num_utxos).toEqual(2)
+
+        // both outpoints are still found
+        await expectToThrow(
+            contracts.utxomng.actions.importutxos([839999, [snapshot_utxo], null]).send('utxomng.xsat@active'),
+            'eosio_assert: utxomng.xsat::importutxos: [utxos] already exists'
+        )
+        await expectToThrow(
+            contracts.utxomng.actions
+                .importutxos([839999, [{ ...snapshot_utxo, index: 2, value: 1000 }], null])
+                .send('utxomng.xsat@active'),
+            'eosio_assert: utxomng.xsat::importutxos: [utxos] already exists'
+        )
+
+        await contracts.utxomng.actions.delutxo([probed_utxo_id]).send('utxomng.xsat@active')
+        await contracts.utxomng.actions.delutxo([snapshot_utxo_id]).send('utxomng.xsat@active')
+        expect(get_chain_state().num_utxos).toEqual(0)
+        expect(get_chain_state().utxo_set_hash).toEqual('0000000000000000000000000000000000000000000000000000000000000000')
+    })
+
     it('addblock: missing required authority utxomng.xsat', async () => {
         await expectToThrow(
             contracts.utxomng.actions
@@ -306,6 +726,14 @@ describe('utxomng.xsat', () => {
         }
         await contracts.utxomng.actions.addblock(block).send('utxomng.xsat@active')
         expect(get_block(839999)).toEqual(block)
+        expect(get_header_ring(839999)).toEqual({
+            height: block.height,
+            hash: block.hash,
+            previous_block_hash: block.previous_block_hash,
+            cumulative_work: block.cumulative_work,
+            timestamp: block.timestamp,
+            bits: block.bits,
+        })
     })
 
     it('delblock: missing required authority utxomng.xsat', async () => {
@@ -325,6 +753,7 @@ describe('utxomng.xsat', () => {
     it('delblock', async () => {
         await contracts.utxomng.actions.delblock([839999]).send('utxomng.xsat@active')
         expect(get_block(839999)).toEqual(undefined)
+        expect(get_header_ring(839999)).toEqual(undefined)
     })
 
     it('init: missing required authority', async () => {
@@ -405,6 +834,8 @@ describe('utxomng.xsat', () => {
             parser: '',
             num_validators_assigned: 0,
             num_provider_validators: 0,
+            next_spent_utxo_id: 1,
+            utxo_set_hash: '0000000000000000000000000000000000000000000000000000000000000000',
         })
     })
 
@@ -428,6 +859,47 @@ describe('utxomng.xsat', () => {
         })
     })
 
+    it('setbudget: missing required authority', async () => {
+        await expectToThrow(
+            contracts.utxomng.actions.setbudget([4000000, 1000000]).send('alice'),
+            'missing required authority utxomng.xsat'
+        )
+    })
+
+    it('setbudget', async () => {
+        await contracts.utxomng.actions.setbudget([0, 0]).send('utxomng.xsat')
+        expect(get_config()).toEqual({
+            num_merkle_layer: 11,
+            num_miner_priority_blocks: 0,
+            num_retain_data_blocks: 100,
+            num_txs_per_verification: 2048,
+            num_validators_per_distribution: 100,
+            parse_timeout_seconds: 600,
+            retained_spent_utxo_blocks: 5000,
+            verification_budget: 0,
+            parse_budget: 0,
+        })
+    })
+
+    it('setindexing: missing required authority', async () => {
+        await expectToThrow(
+            contracts.utxomng.actions.setindexing([true]).send('alice'),
+            'missing required authority utxomng.xsat'
+        )
+    })
+
+    it('setindexing', async () => {
+        await contracts.utxomng.actions.setindexing([true]).send('utxomng.xsat')
+        expect(get_config().index_pending_utxos).toEqual(true)
+        await contracts.utxomng.actions.setindexing([false]).send('utxomng.xsat')
+        expect(get_config().index_pending_utxos).toEqual(false)
+    })
+
+    it('setindexing: index the pending utxos of the following blocks', async () => {
+        await contracts.utxomng.actions.setindexing([true]).send('utxomng.xsat')
+        expect(get_config().index_pending_utxos).toEqual(true)
+    })
+
     it('consensus: 839999', async () => {
         await contracts.utxomng.actions
             .addblock({
@@ -479,106 +951,113 @@ describe('utxomng.xsat', () => {
             migrating_num_utxos: 0,
             parsed_height: 839999,
             parsing_height: 840000,
-            parsing_progress_of: [
-                {
-                    first: hash,
-                    second: {
-                        bucket_id: 1,
-                        num_utxos: 0,
-                        num_transactions: 0,
-                        parsed_position: 0,
-                        parsed_transactions: 0,
-                        parsed_vin: 0,
-                        parsed_vout: 0,
-                        parser: 'bob',
-                        parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
-                    },
-                },
-            ],
+            parsing_progress_of: [],
             synchronizer: '',
             miner: '',
             parser: '',
             num_validators_assigned: 0,
             num_provider_validators: 0,
             status: 1,
+            next_spent_utxo_id: 1,
+            utxo_set_hash: '0000000000000000000000000000000000000000000000000000000000000000',
         })
+        expect(get_block_parsing()).toEqual([
+            {
+                bucket_id: 1,
+                hash: hash,
+                progress: {
+                    bucket_id: 1,
+                    num_utxos: 0,
+                    num_transactions: 0,
+                    parsed_position: 0,
+                    parsed_transactions: 0,
+                    parsed_vin: 0,
+                    parsed_vout: 0,
+                    parser: 'bob',
+                    parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
+                },
+            },
+        ])
     })
 
-    it('parse 840000', async () => {
-        //coinbase 1 vin 2 vout
+    it('parse 840000: synchronizers parse different ranges', async () => {
+        const hash = '0000000000000000000320283a032748cef8227873ff4872689bf23f1cda83a5'
+        // coinbase 1 vin, the block parser starts on range 0
         await contracts.utxomng.actions.processblock(['bob', 1, get_nonce()]).send('bob@active')
-        expect(get_chain_state()).toEqual({
-            head_height: 840000,
-            irreversible_hash: '0000000000000000000172014ba58d66455762add0512355ad651207918494ab',
-            irreversible_height: 839999,
-            num_utxos: 0,
-            migrating_height: 0,
-            migrating_hash: '0000000000000000000000000000000000000000000000000000000000000000',
-            migrated_num_utxos: 0,
-            migrating_num_utxos: 0,
-            parsed_height: 839999,
-            parsing_height: 840000,
-            parsing_progress_of: [
-                {
-                    first: '0000000000000000000320283a032748cef8227873ff4872689bf23f1cda83a5',
-                    second: {
-                        bucket_id: 1,
-                        num_transactions: 3050,
-                        parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
-                        parsed_position: 0,
-                        parsed_transactions: 0,
-                        parsed_vin: 1,
-                        parsed_vout: 0,
-                        parser: 'bob',
-                        num_utxos: 0,
-                    },
-                },
-            ],
-            synchronizer: '',
-            miner: '',
-            parser: '',
-            num_validators_assigned: 0,
-            num_provider_validators: 0,
-            status: 5,
+        expect(decodeReturn_processblock(blockchain.actionTraces[0].returnValue)).toEqual({
+            status: 'parsing',
+            height: 840000,
+            block_hash: hash,
         })
+        // 840000 was verified in two rounds, the second round starts at transaction 2048
+        let parse_ranges = get_parse_ranges(1)
+        expect(parse_ranges.map(({ id, from_transaction }) => ({ id, from_transaction }))).toEqual([
+            { id: 0, from_transaction: 0 },
+            { id: 1, from_transaction: 2048 },
+        ])
+        expect(parse_ranges[0].progress).toEqual(
+            expect.objectContaining({ num_transactions: 2048, parsed_transactions: 0, parsed_vin: 1, parser: 'bob' })
+        )
+        expect(parse_ranges[1].progress).toEqual(
+            expect.objectContaining({ num_transactions: 1002, parsed_transactions: 0, parsed_vin: 0, parser: '' })
+        )
+        expect(get_block_parsing()[0].progress).toEqual(
+            expect.objectContaining({ num_transactions: 3050, parsed_transactions: 0, parser: 'bob' })
+        )
 
-        await contracts.utxomng.actions.processblock(['bob', 1, get_nonce()]).send('bob@active')
-        expect(get_chain_state()).toEqual({
-            head_height: 840000,
-            irreversible_hash: '0000000000000000000172014ba58d66455762add0512355ad651207918494ab',
-            irreversible_height: 839999,
-            num_utxos: 0,
-            migrating_height: 0,
-            migrating_hash: '0000000000000000000000000000000000000000000000000000000000000000',
-            migrated_num_utxos: 0,
-            migrating_num_utxos: 0,
-            parsed_height: 839999,
-            parsing_height: 840000,
-            parsing_progress_of: [
-                {
-                    first: '0000000000000000000320283a032748cef8227873ff4872689bf23f1cda83a5',
-                    second: {
-                        bucket_id: 1,
-                        num_utxos: 1,
-                        num_transactions: 3050,
-                        parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
-                        parsed_position: 0,
-                        parsed_transactions: 0,
-                        parsed_vin: 1,
-                        parsed_vout: 1,
-                        parser: 'bob',
-                    },
-                },
-            ],
-            synchronizer: '',
-            miner: '',
-            parser: '',
-            num_validators_assigned: 0,
-            num_provider_validators: 0,
-            status: 5,
+        // another synchronizer claims the range that nobody holds
+        await contracts.utxomng.actions.processblock(['alice', 1, get_nonce()]).send('alice@active')
+        parse_ranges = get_parse_ranges(1)
+        expect(parse_ranges[1].progress).toEqual(
+            expect.objectContaining({
+                parser: 'alice',
+                parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
+            })
+        )
+        expect(parse_ranges[1].progress.parsed_vin + parse_ranges[1].progress.parsed_vout).toEqual(1)
+        expect(parse_ranges[0].progress.parser).toEqual('bob')
+
+        // the block parser finishes its range, then waits for the range held by alice
+        await contracts.utxomng.actions.processblock(['bob', 0, get_nonce()]).send('bob@active')
+        parse_ranges = get_parse_ranges(1)
+        expect(parse_ranges[0].progress.parsed_transactions).toEqual(2048)
+        expect(parse_ranges[1].progress.parsed_transactions).toBeLessThan(1002)
+        await contracts.utxomng.actions.processblock(['bob', 0, get_nonce()]).send('bob@active')
+        expect(decodeReturn_processblock(blockchain.actionTraces[0].returnValue)).toEqual({
+            status: 'waiting_ranges',
+            height: 840000,
+            block_hash: hash,
         })
 
+        // the block progress sums up its ranges
+        const block_progress = get_block_parsing()[0].progress
+        expect(block_progress.parsed_transactions).toEqual(
+            parse_ranges[0].progress.parsed_transactions + parse_ranges[1].progress.parsed_transactions
+        )
+        expect(block_progress.num_utxos).toEqual(parse_ranges[0].progress.num_utxos + parse_ranges[1].progress.num_utxos)
+
+        // the range of alice expires and is taken over
+        blockchain.addTime(TimePointSec.from(601))
         await contracts.utxomng.actions.processblock(['bob', 0, get_nonce()]).send('bob@active')
+        expect(decodeReturn_processblock(blockchain.actionTraces[0].returnValue).status).toEqual('parsing_completed')
+        parse_ranges = get_parse_ranges(1)
+        expect(parse_ranges[1].progress).toEqual(expect.objectContaining({ parsed_transactions: 1002, parser: 'bob' }))
+        expect(get_consensus_block(1).num_utxos).toEqual(
+            parse_ranges[0].progress.num_utxos + parse_ranges[1].progress.num_utxos
+        )
+
+        // pages are keyed by range then page, migration replays range 0 before range 1 and each range in order
+        const pages = contracts.utxomng.tables
+            .pendingpages(BigInt(1))
+            .getTableRows()
+            .map(({ page }) => ({ range: Number(BigInt(page) >> 32n), page: Number(BigInt(page) & 0xffffffffn) }))
+        expect(pages.map(({ range }) => range)).toEqual([...pages.map(({ range }) => range)].sort((a, b) => a - b))
+        for (const range of [0, 1]) {
+            const range_pages = pages.filter(page => page.range == range).map(({ page }) => page)
+            expect(range_pages.length).toBeGreaterThan(0)
+            expect(range_pages).toEqual(range_pages.map((_, index) => index))
+        }
+
         expect(get_chain_state()).toEqual({
             head_height: 840000,
             irreversible_hash: '0000000000000000000172014ba58d66455762add0512355ad651207918494ab',
@@ -597,7 +1076,10 @@ describe('utxomng.xsat', () => {
             num_validators_assigned: 0,
             num_provider_validators: 0,
             status: 1,
+            next_spent_utxo_id: 1,
+            utxo_set_hash: '0000000000000000000000000000000000000000000000000000000000000000',
         })
+        expect(get_block_parsing()).toEqual([])
 
         expect(get_consensus_block(1).parser).toEqual('bob')
     })
@@ -640,29 +1122,33 @@ describe('utxomng.xsat', () => {
             migrating_num_utxos: 0,
             parsed_height: 840000,
             parsing_height: 840001,
-            parsing_progress_of: [
-                {
-                    first: hash,
-                    second: {
-                        bucket_id: 2,
-                        num_utxos: 0,
-                        num_transactions: 0,
-                        parsed_position: 0,
-                        parsed_transactions: 0,
-                        parsed_vin: 0,
-                        parsed_vout: 0,
-                        parser: 'alice',
-                        parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
-                    },
-                },
-            ],
+            parsing_progress_of: [],
             synchronizer: '',
             miner: '',
             parser: '',
             num_validators_assigned: 0,
             num_provider_validators: 0,
             status: 1,
+            next_spent_utxo_id: 1,
+            utxo_set_hash: '0000000000000000000000000000000000000000000000000000000000000000',
         })
+        expect(get_block_parsing()).toEqual([
+            {
+                bucket_id: 2,
+                hash: hash,
+                progress: {
+                    bucket_id: 2,
+                    num_utxos: 0,
+                    num_transactions: 0,
+                    parsed_position: 0,
+                    parsed_transactions: 0,
+                    parsed_vin: 0,
+                    parsed_vout: 0,
+                    parser: 'alice',
+                    parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
+                },
+            },
+        ])
     })
 
     it('parse 840001: you are not a parser of the current block', async () => {
@@ -674,7 +1160,7 @@ describe('utxomng.xsat', () => {
 
     it('parse 840001', async () => {
         blockchain.addTime(TimePointSec.from(600))
-        await contracts.utxomng.actions.processblock(['bob', 0, get_nonce()]).send('bob@active')
+        await parse_block('bob')
 
         expect(get_consensus_block(2).parser).toEqual('bob')
 
@@ -696,6 +1182,8 @@ describe('utxomng.xsat', () => {
             num_validators_assigned: 0,
             num_provider_validators: 0,
             status: 1,
+            next_spent_utxo_id: 1,
+            utxo_set_hash: '0000000000000000000000000000000000000000000000000000000000000000',
         })
     })
 
@@ -852,7 +1340,14 @@ describe('utxomng.xsat', () => {
 
     it('parse 840002', async () => {
         blockchain.addTime(TimePointSec.from(600))
-        await contracts.utxomng.actions.processblock(['alice', 0, get_nonce()]).send('alice@active')
+        // the first round ends with tx 56, 226 vins and vouts
+        await contracts.utxomng.actions.processblock(['alice', 226, get_nonce()]).send('alice@active')
+        const txid = '6db89472021100c53b40d14160b9b805d536c74ca65026429626fd4f78107286'
+        const { page, slot, utxo } = find_pending_utxo(3, txid, 0)
+        expect(utxo.type).toEqual('vout')
+        expect(get_pending_index(3)).toContainEqual({ page, slot })
+
+        await parse_block('alice')
         expect(get_chain_state()).toEqual({
             head_height: 840007,
             irreversible_hash: '0000000000000000000172014ba58d66455762add0512355ad651207918494ab',
@@ -864,34 +1359,55 @@ describe('utxomng.xsat', () => {
             migrating_num_utxos: 0,
             parsed_height: 840002,
             parsing_height: 840003,
-            parsing_progress_of: [
-                {
-                    first: '00000000000000000001cfe8671cb9269dfeded2c4e900e365fffae09b34b119',
-                    second: {
-                        bucket_id: 4,
-                        num_utxos: 0,
-                        num_transactions: 0,
-                        parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
-                        parsed_position: 0,
-                        parsed_transactions: 0,
-                        parsed_vin: 0,
-                        parsed_vout: 0,
-                        parser: 'alice',
-                    },
-                },
-            ],
+            parsing_progress_of: [],
             synchronizer: '',
             miner: '',
             parser: '',
             num_validators_assigned: 0,
             num_provider_validators: 0,
             status: 1,
+            next_spent_utxo_id: 1,
+            utxo_set_hash: '0000000000000000000000000000000000000000000000000000000000000000',
         })
+        expect(get_block_parsing()).toEqual([
+            {
+                bucket_id: 4,
+                hash: '00000000000000000001cfe8671cb9269dfeded2c4e900e365fffae09b34b119',
+                progress: {
+                    bucket_id: 4,
+                    num_utxos: 0,
+                    num_transactions: 0,
+                    parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
+                    parsed_position: 0,
+                    parsed_transactions: 0,
+                    parsed_vin: 0,
+                    parsed_vout: 0,
+                    parser: 'alice',
+                },
+            },
+        ])
+    })
+
+    it('parse 840002: net create-then-spend pairs', async () => {
+        // vout 0 of tx 56 is spent by tx 57 in a later round, found through pendingindex
+        const txid = '6db89472021100c53b40d14160b9b805d536c74ca65026429626fd4f78107286'
+        const pending_utxos = get_pending_utxos(3)
+        const netted_utxos = pending_utxos.filter(row => row.txid == txid && row.index == 0)
+        expect(netted_utxos).toEqual([expect.objectContaining({ txid, index: 0, type: 'spent' })])
+        // the script and value are kept for the spent history
+        expect(netted_utxos[0].scriptpubkey).not.toEqual('')
+        expect(netted_utxos[0].value).toBeGreaterThan(0)
+        expect(pending_utxos.length).toBeLessThan(get_consensus_block(3).num_utxos)
+
+        // the spent vout leaves the index
+        const { page, slot } = find_pending_utxo(3, txid, 0)
+        expect(get_pending_index(3)).not.toContainEqual({ page, slot })
+        expect(get_pending_index(3).length).toBeGreaterThan(0)
     })
 
     it('parse 840003', async () => {
         blockchain.addTime(TimePointSec.from(600))
-        await contracts.utxomng.actions.processblock(['alice', 0, get_nonce()]).send('alice@active')
+        await parse_block('alice')
         expect(get_chain_state()).toEqual({
             head_height: 840007,
             irreversible_hash: '0000000000000000000172014ba58d66455762add0512355ad651207918494ab',
@@ -903,34 +1419,38 @@ describe('utxomng.xsat', () => {
             migrating_num_utxos: 0,
             parsed_height: 840003,
             parsing_height: 840004,
-            parsing_progress_of: [
-                {
-                    first: '000000000000000000028458274b1f458d57d817fdce349e31dd5cb51b277d36',
-                    second: {
-                        bucket_id: 5,
-                        num_utxos: 0,
-                        num_transactions: 0,
-                        parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
-                        parsed_position: 0,
-                        parsed_transactions: 0,
-                        parsed_vin: 0,
-                        parsed_vout: 0,
-                        parser: 'alice',
-                    },
-                },
-            ],
+            parsing_progress_of: [],
             synchronizer: '',
             miner: '',
             parser: '',
             num_validators_assigned: 0,
             num_provider_validators: 0,
             status: 1,
+            next_spent_utxo_id: 1,
+            utxo_set_hash: '0000000000000000000000000000000000000000000000000000000000000000',
         })
+        expect(get_block_parsing()).toEqual([
+            {
+                bucket_id: 5,
+                hash: '000000000000000000028458274b1f458d57d817fdce349e31dd5cb51b277d36',
+                progress: {
+                    bucket_id: 5,
+                    num_utxos: 0,
+                    num_transactions: 0,
+                    parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
+                    parsed_position: 0,
+                    parsed_transactions: 0,
+                    parsed_vin: 0,
+                    parsed_vout: 0,
+                    parser: 'alice',
+                },
+            },
+        ])
     })
 
     it('parse 840004', async () => {
         blockchain.addTime(TimePointSec.from(600))
-        await contracts.utxomng.actions.processblock(['alice', 0, get_nonce()]).send('alice@active')
+        await parse_block('alice')
         expect(get_chain_state()).toEqual({
             head_height: 840007,
             irreversible_hash: '0000000000000000000172014ba58d66455762add0512355ad651207918494ab',
@@ -942,34 +1462,38 @@ describe('utxomng.xsat', () => {
             migrating_num_utxos: 0,
             parsed_height: 840004,
             parsing_height: 840005,
-            parsing_progress_of: [
-                {
-                    first: '000000000000000000027b0ec0e3acadd018cd19e7dd976602f216a1bc12d079',
-                    second: {
-                        bucket_id: 6,
-                        num_utxos: 0,
-                        num_transactions: 0,
-                        parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
-                        parsed_position: 0,
-                        parsed_transactions: 0,
-                        parsed_vin: 0,
-                        parsed_vout: 0,
-                        parser: 'alice',
-                    },
-                },
-            ],
+            parsing_progress_of: [],
             synchronizer: '',
             miner: '',
             parser: '',
             num_validators_assigned: 0,
             num_provider_validators: 0,
             status: 1,
+            next_spent_utxo_id: 1,
+            utxo_set_hash: '0000000000000000000000000000000000000000000000000000000000000000',
         })
+        expect(get_block_parsing()).toEqual([
+            {
+                bucket_id: 6,
+                hash: '000000000000000000027b0ec0e3acadd018cd19e7dd976602f216a1bc12d079',
+                progress: {
+                    bucket_id: 6,
+                    num_utxos: 0,
+                    num_transactions: 0,
+                    parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
+                    parsed_position: 0,
+                    parsed_transactions: 0,
+                    parsed_vin: 0,
+                    parsed_vout: 0,
+                    parser: 'alice',
+                },
+            },
+        ])
     })
 
     it('parse 840005', async () => {
         blockchain.addTime(TimePointSec.from(600))
-        await contracts.utxomng.actions.processblock(['alice', 0, get_nonce()]).send('alice@active')
+        await parse_block('alice')
         expect(get_chain_state()).toEqual({
             head_height: 840007,
             irreversible_hash: '0000000000000000000172014ba58d66455762add0512355ad651207918494ab',
@@ -981,35 +1505,41 @@ describe('utxomng.xsat', () => {
             migrated_num_utxos: 0,
             parsed_height: 840005,
             parsing_height: 840006,
-            parsing_progress_of: [
-                {
-                    first: '0000000000000000000098dab8c28e5f20ab1663b8dd6c81bb54bbbcd0ead5ac',
-                    second: {
-                        bucket_id: 7,
-                        num_utxos: 0,
-                        num_transactions: 0,
-                        parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
-                        parsed_position: 0,
-                        parsed_transactions: 0,
-                        parsed_vin: 0,
-                        parsed_vout: 0,
-                        parser: 'alice',
-                    },
-                },
-            ],
+            parsing_progress_of: [],
             synchronizer: 'bob',
             miner: 'bob',
             parser: 'bob',
             num_validators_assigned: 0,
             num_provider_validators: 4,
             status: 1,
+            next_spent_utxo_id: 1,
+            utxo_set_hash: '0000000000000000000000000000000000000000000000000000000000000000',
         })
+        expect(get_block_parsing()).toEqual([
+            {
+                bucket_id: 7,
+                hash: '0000000000000000000098dab8c28e5f20ab1663b8dd6c81bb54bbbcd0ead5ac',
+                progress: {
+                    bucket_id: 7,
+                    num_utxos: 0,
+                    num_transactions: 0,
+                    parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
+                    parsed_position: 0,
+                    parsed_transactions: 0,
+                    parsed_vin: 0,
+                    parsed_vout: 0,
+                    parser: 'alice',
+                },
+            },
+        ])
     })
 
-    it('parse 840006: migrate utxo', async () => {
-        blockchain.addTime(TimePointSec.from(600))
+    it('migrate 840000 while parsing 840006: migrate utxo', async () => {
+        const netted_utxos = get_pending_utxos(1).filter(row => row.type == 'spent')
+        expect(netted_utxos.length).toBeGreaterThan(0)
+        expect(get_pending_index(1).length).toBeGreaterThan(0)
         while (true) {
-            await contracts.utxomng.actions.processblock(['alice', 5000, get_nonce()]).send('alice@active')
+            await contracts.utxomng.actions.processblock(['bob', 5000, get_nonce()]).send('bob@active')
             if (get_chain_state().status == 3) {
                 break
             }
@@ -1025,22 +1555,7 @@ describe('utxomng.xsat', () => {
             migrating_num_utxos: 11447,
             parsed_height: 840005,
             parsing_height: 840006,
-            parsing_progress_of: [
-                {
-                    first: '0000000000000000000098dab8c28e5f20ab1663b8dd6c81bb54bbbcd0ead5ac',
-                    second: {
-                        bucket_id: 7,
-                        num_utxos: 0,
-                        num_transactions: 0,
-                        parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
-                        parsed_position: 0,
-                        parsed_transactions: 0,
-                        parsed_vin: 0,
-                        parsed_vout: 0,
-                        parser: 'alice',
-                    },
-                },
-            ],
+            parsing_progress_of: [],
             synchronizer: 'bob',
             miner: 'bob',
             parser: 'bob',
@@ -1048,11 +1563,42 @@ describe('utxomng.xsat', () => {
             num_provider_validators: 4,
             status: 3,
         })
+        expect(get_chain_state().migrated_num_utxos).toEqual(get_consensus_block(1).num_utxos)
+
+        // pairs created and spent in 840000 never enter utxos, their spent history is kept in spentutxos
+        const utxos = contracts.utxomng.tables.utxos().getTableRows()
+        const spent_utxos = get_spent_utxos()
+        for (const { txid, index, scriptpubkey, value } of netted_utxos) {
+            expect(utxos.find(row => row.txid == txid && row.index == index)).toBeUndefined()
+            const spent_utxo = spent_utxos.find(row => row.txid == txid && row.index == index)
+            expect(spent_utxo).toEqual(expect.objectContaining({ height: 840000, txid, index, value }))
+            // saved decompressed, the pending row keeps the template payload
+            expect(spent_utxo.scriptpubkey).toContain(scriptpubkey)
+        }
+        expect(get_block_parsing()).toEqual([
+            {
+                bucket_id: 7,
+                hash: '0000000000000000000098dab8c28e5f20ab1663b8dd6c81bb54bbbcd0ead5ac',
+                progress: {
+                    bucket_id: 7,
+                    num_utxos: 0,
+                    num_transactions: 0,
+                    parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
+                    parsed_position: 0,
+                    parsed_transactions: 0,
+                    parsed_vin: 0,
+                    parsed_vout: 0,
+                    parser: 'alice',
+                },
+            },
+        ])
     })
 
-    it('parse 840006: delete data', async () => {
-        blockchain.addTime(TimePointSec.from(600))
-        await contracts.utxomng.actions.processblock(['alice', 0, get_nonce()]).send('alice@active')
+    it('migrate 840000 while parsing 840006: delete data', async () => {
+        await contracts.utxomng.actions.processblock(['bob', 0, get_nonce()]).send('bob@active')
+        expect(get_pending_utxos(1)).toEqual([])
+        expect(get_pending_index(1)).toEqual([])
+        expect(get_parse_ranges(1)).toEqual([])
         expect(get_chain_state()).toEqual({
             head_height: 840007,
             irreversible_hash: '0000000000000000000172014ba58d66455762add0512355ad651207918494ab',
@@ -1064,22 +1610,7 @@ describe('utxomng.xsat', () => {
             migrating_num_utxos: 11447,
             parsed_height: 840005,
             parsing_height: 840006,
-            parsing_progress_of: [
-                {
-                    first: '0000000000000000000098dab8c28e5f20ab1663b8dd6c81bb54bbbcd0ead5ac',
-                    second: {
-                        bucket_id: 7,
-                        num_utxos: 0,
-                        num_transactions: 0,
-                        parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
-                        parsed_position: 0,
-                        parsed_transactions: 0,
-                        parsed_vin: 0,
-                        parsed_vout: 0,
-                        parser: 'alice',
-                    },
-                },
-            ],
+            parsing_progress_of: [],
             synchronizer: 'bob',
             miner: 'bob',
             parser: 'bob',
@@ -1087,11 +1618,27 @@ describe('utxomng.xsat', () => {
             num_provider_validators: 4,
             status: 4,
         })
+        expect(get_block_parsing()).toEqual([
+            {
+                bucket_id: 7,
+                hash: '0000000000000000000098dab8c28e5f20ab1663b8dd6c81bb54bbbcd0ead5ac',
+                progress: {
+                    bucket_id: 7,
+                    num_utxos: 0,
+                    num_transactions: 0,
+                    parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
+                    parsed_position: 0,
+                    parsed_transactions: 0,
+                    parsed_vin: 0,
+                    parsed_vout: 0,
+                    parser: 'alice',
+                },
+            },
+        ])
     })
 
-    it('parse 840006: distribute rewards', async () => {
-        blockchain.addTime(TimePointSec.from(600))
-        await contracts.utxomng.actions.processblock(['alice', 0, get_nonce()]).send('alice@active'),
+    it('migrate 840000 while parsing 840006: distribute rewards', async () => {
+        await contracts.utxomng.actions.processblock(['bob', 0, get_nonce()]).send('bob@active'),
             expect(get_chain_state()).toEqual({
                 head_height: 840007,
                 irreversible_hash: '0000000000000000000320283a032748cef8227873ff4872689bf23f1cda83a5',
@@ -1103,22 +1650,7 @@ describe('utxomng.xsat', () => {
                 num_utxos: 6683,
                 parsed_height: 840005,
                 parsing_height: 840006,
-                parsing_progress_of: [
-                    {
-                        first: '0000000000000000000098dab8c28e5f20ab1663b8dd6c81bb54bbbcd0ead5ac',
-                        second: {
-                            bucket_id: 7,
-                            num_utxos: 0,
-                            num_transactions: 0,
-                            parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
-                            parsed_position: 0,
-                            parsed_transactions: 0,
-                            parsed_vin: 0,
-                            parsed_vout: 0,
-                            parser: 'alice',
-                        },
-                    },
-                ],
+                parsing_progress_of: [],
                 synchronizer: '',
                 miner: '',
                 parser: '',
@@ -1126,11 +1658,28 @@ describe('utxomng.xsat', () => {
                 num_provider_validators: 0,
                 status: 5,
             })
+            expect(get_block_parsing()).toEqual([
+                {
+                    bucket_id: 7,
+                    hash: '0000000000000000000098dab8c28e5f20ab1663b8dd6c81bb54bbbcd0ead5ac',
+                    progress: {
+                        bucket_id: 7,
+                        num_utxos: 0,
+                        num_transactions: 0,
+                        parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
+                        parsed_position: 0,
+                        parsed_transactions: 0,
+                        parsed_vin: 0,
+                        parsed_vout: 0,
+                        parser: 'alice',
+                    },
+                },
+            ])
     })
 
     it('parse 840006: parse', async () => {
         blockchain.addTime(TimePointSec.from(600))
-        await contracts.utxomng.actions.processblock(['alice', 0, get_nonce()]).send('alice@active'),
+        await parse_block('alice'),
             expect(get_chain_state()).toEqual({
                 head_height: 840007,
                 irreversible_hash: '0000000000000000000320283a032748cef8227873ff4872689bf23f1cda83a5',
@@ -1141,22 +1690,7 @@ describe('utxomng.xsat', () => {
                 migrating_num_utxos: 11888,
                 parsed_height: 840006,
                 parsing_height: 840007,
-                parsing_progress_of: [
-                    {
-                        first: '000000000000000000030d1455700ec234e4214e75e8e1112632b74febe80c78',
-                        second: {
-                            bucket_id: 8,
-                            num_transactions: 0,
-                            num_utxos: 0,
-                            parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
-                            parsed_position: 0,
-                            parsed_transactions: 0,
-                            parsed_vin: 0,
-                            parsed_vout: 0,
-                            parser: 'alice',
-                        },
-                    },
-                ],
+                parsing_progress_of: [],
                 synchronizer: 'alice',
                 miner: '',
                 parser: 'bob',
@@ -1165,5 +1699,22 @@ describe('utxomng.xsat', () => {
                 num_provider_validators: 4,
                 status: 1,
             })
+            expect(get_block_parsing()).toEqual([
+                {
+                    bucket_id: 8,
+                    hash: '000000000000000000030d1455700ec234e4214e75e8e1112632b74febe80c78',
+                    progress: {
+                        bucket_id: 8,
+                        num_transactions: 0,
+                        num_utxos: 0,
+                        parse_expiration_time: addTime(blockchain.timestamp, TimePointSec.from(10 * 60)).toString(),
+                        parsed_position: 0,
+                        parsed_transactions: 0,
+                        parsed_vin: 0,
+                        parsed_vout: 0,
+                        parser: 'alice',
+                    },
+                },
+            ])
     })
 })